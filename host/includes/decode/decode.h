@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+ */
+
+/*
+ * Common parts of the host decoders of the kernel dumps, little endian
+ * words and names of the kernel states.
+ */
+
+#ifndef DECODE_H
+#define	DECODE_H
+
+#include <stdint.h>
+
+#include "system/events.h"
+
+/******************************************************************************/
+/* Global Variable Declaration                                                */
+/******************************************************************************/
+
+/// Names of the event priorities, in the order of eventPriority
+static const char* decode_priorities[LNG_EVENTPRIORITY] = {"LOW", "MEDIUM", "HIGH", "VERY_LOW"};
+/// Names of the I2C states, in the order of I2C_states in i2c_controller.c
+static const char* decode_i2c_states[] = {
+    "idle", "startWrite", "restart", "writeCommand",
+    "recen", "recstore", "stopRead", "rerecen",
+    "writeData", "writeStop", "done", "doneFailed", "Failed",
+};
+#define DECODE_I2C_STATES (sizeof(decode_i2c_states) / sizeof(decode_i2c_states[0]))
+
+/*****************************************************************************/
+/* Communication Functions                                                   */
+/*****************************************************************************/
+
+static inline uint16_t decode_u16(const unsigned char* data) {
+    return data[0] | (data[1] << 8);
+}
+
+static inline uint32_t decode_u32(const unsigned char* data) {
+    return decode_u16(data) | ((uint32_t) decode_u16(data + 2) << 16);
+}
+
+#endif	/* DECODE_H */
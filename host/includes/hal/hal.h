@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef HAL_H
+#define	HAL_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>        /* Includes uint16_t definition                    */
+#include <stdbool.h>       /* Includes true/false definition                  */
+
+#include "peripherals/gpio.h"
+
+/******************************************************************************/
+/* System Level #define Macros                                                */
+/******************************************************************************/
+    /// Max number of interrupt routines
+    #ifndef HAL_MAX_INTERRUPTS
+    #define HAL_MAX_INTERRUPTS 16
+    #endif
+    /// Priority of the CPU out of the interrupts
+    #define HAL_IPL_MAIN 0
+    /// Max priority of the CPU
+    #define HAL_IPL_MAX 7
+
+    /// Power save modes, as the argument of PWRSAV
+    #define HAL_POWER_SLEEP 0
+    #define HAL_POWER_IDLE 1
+
+    /// Interrupt routine
+    typedef void (*hal_isr_t)(void);
+    /// Power save of the CPU, waits up to an interrupt
+    typedef void (*hal_power_t)(unsigned int mode);
+
+    /// Interrupt of the mock
+    typedef struct _hal_interrupt {
+        hardware_bit_t* flag;       ///< Interrupt flag
+        unsigned int ipl;           ///< Priority of the interrupt, 1 to 7
+        hal_isr_t isr;              ///< Interrupt routine
+        uint32_t count;             ///< Number of calls
+    } hal_interrupt_t;
+
+/******************************************************************************/
+/* Global Variable Declaration                                                */
+/******************************************************************************/
+    /// Priority of the CPU, as the IPL bits of SR
+    extern volatile unsigned int hal_cpu_ipl;
+
+/******************************************************************************/
+/* System Function Prototypes                                                 */
+/******************************************************************************/
+    /**
+     * Remove all interrupts and move the CPU at the main priority
+     */
+    void hal_init(void);
+    /**
+     * Connect an interrupt routine to a flag. The flag is a bit of a plain
+     * register of the user, the kernel sets it as a software interrupt.
+     * @param flag interrupt flag
+     * @param ipl priority of the interrupt, 1 to 7
+     * @param isr interrupt routine
+     * @return false without free interrupts
+     */
+    bool hal_interrupt_register(hardware_bit_t* flag, unsigned int ipl, hal_isr_t isr);
+    /**
+     * Run the pending interrupts with priority over the CPU, from the
+     * highest. The flag is cleared before the routine. An interrupt raised
+     * inside a routine preempts it if it has a higher priority and the
+     * routine restores the CPU priority. The mock checks the flags only
+     * here: the host program calls it where the hardware would take the
+     * interrupt, the restore of the CPU priority calls it too.
+     */
+    void hal_interrupt_dispatch(void);
+    /**
+     * Number of calls of an interrupt routine
+     * @param flag interrupt flag
+     * @return calls of the routine, 0 if the flag is not registered
+     */
+    uint32_t hal_interrupt_count(hardware_bit_t* flag);
+    /**
+     * Connect the power save instruction to the host program, the program
+     * moves the time to the next interrupt and sets its flag
+     * @param power function of the program, NULL to return at once
+     */
+    void hal_power_register(hal_power_t power);
+    /**
+     * Power save instruction, for Idle() and Sleep(). As on the hardware
+     * the pending interrupts wake the CPU and run only if their priority is
+     * over the CPU priority.
+     * @param mode HAL_POWER_IDLE or HAL_POWER_SLEEP
+     */
+    void hal_power_save(unsigned int mode);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* HAL_H */
+
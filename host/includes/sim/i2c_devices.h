@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef I2C_DEVICES_H
+#define	I2C_DEVICES_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>        /* Includes uint16_t definition                    */
+#include <stdbool.h>       /* Includes true/false definition                  */
+
+#include "sim/i2c_sim.h"
+#include "peripherals/i2c_slave.h"
+
+/******************************************************************************/
+/* System Level #define Macros                                                */
+/******************************************************************************/
+    /// Max size of a virtual EEPROM
+    #define I2C_EEPROM_MAX_SIZE 4096
+    /// Page of a virtual EEPROM, the writes wrap in the page
+    #define I2C_EEPROM_PAGE 32
+    /// Number of registers of a register map
+    #define I2C_REGMAP_SIZE 256
+
+    /// Registers of the virtual IMU, as a MPU-6050
+    #define I2C_IMU_ADDRESS      0x68
+    #define I2C_IMU_ACCEL_XOUT_H 0x3B
+    #define I2C_IMU_GYRO_XOUT_H  0x43
+    #define I2C_IMU_PWR_MGMT_1   0x6B
+    #define I2C_IMU_WHO_AM_I     0x75
+    /// Size of a full sample: accelerometer, temperature and gyroscope
+    #define I2C_IMU_SAMPLE_SIZE  14
+
+    /**
+     * EEPROM with a 16 bit address pointer, as a 24LC32. The first two
+     * bytes of a write move the pointer, the next bytes are written in the
+     * page of the pointer. A read starts from the pointer.
+     */
+    typedef struct _i2c_eeprom {
+        i2c_sim_device_t device;    ///< Device on the bus
+        unsigned char memory[I2C_EEPROM_MAX_SIZE]; ///< Content
+        uint16_t size;              ///< Size of the memory
+        uint16_t pointer;           ///< Address pointer
+        unsigned char phase;        ///< Bytes of the address received
+        uint32_t writes;            ///< Bytes written
+    } i2c_eeprom_t;
+
+    typedef struct _i2c_regmap i2c_regmap_t;
+    /// Update of the registers, launched before a read
+    typedef void (*i2c_regmap_update_t)(i2c_regmap_t* regmap);
+    /**
+     * Device with 8 bit registers. The first byte of a write moves the
+     * pointer, the pointer increases after each byte.
+     */
+    struct _i2c_regmap {
+        i2c_sim_device_t device;    ///< Device on the bus
+        unsigned char regs[I2C_REGMAP_SIZE]; ///< Registers
+        unsigned char pointer;      ///< Register pointer
+        bool pointer_set;           ///< The pointer is written in this transaction
+        i2c_regmap_update_t update; ///< Update before a read, can be NULL
+        uint32_t samples;           ///< Number of updates
+    };
+
+    /**
+     * Registers of a slave controller wired on the simulated bus: every
+     * step of the bus sets the status as the hardware and runs the slave
+     * manager, as the interrupt of the slave.
+     */
+    typedef struct _i2c_slave_port {
+        i2c_sim_device_t device;    ///< Device on the bus
+        i2c_slave_t* slave;         ///< Slave of the kernel
+        volatile unsigned int CON, STAT, ADD, TRN, RCV, IFS; ///< Registers of the slave
+        hardware_bit_t interrupt;   ///< Interrupt of the slave
+    } i2c_slave_port_t;
+
+/******************************************************************************/
+/* System Function Prototypes                                                 */
+/******************************************************************************/
+    /**
+     * Initialize an erased EEPROM
+     * @param eeprom the EEPROM
+     * @param address 7 bit address
+     * @param size size of the memory, max I2C_EEPROM_MAX_SIZE
+     * @return the device to attach on the bus
+     */
+    i2c_sim_device_t* i2c_eeprom_init(i2c_eeprom_t* eeprom, unsigned char address, uint16_t size);
+    /**
+     * Initialize a register map with all registers to zero
+     * @param regmap the register map
+     * @param address 7 bit address
+     * @param update update before a read, can be NULL
+     * @return the device to attach on the bus
+     */
+    i2c_sim_device_t* i2c_regmap_init(i2c_regmap_t* regmap, unsigned char address, i2c_regmap_update_t update);
+    /**
+     * Initialize an IMU: a register map with the identity and a new
+     * deterministic sample on every read of the sample registers
+     * @param imu the register map
+     * @param address 7 bit address
+     * @return the device to attach on the bus
+     */
+    i2c_sim_device_t* i2c_imu_init(i2c_regmap_t* imu, unsigned char address);
+    /**
+     * Initialize a slave of the kernel on the registers of the port
+     * @param port the port
+     * @param slave the slave, initialized with I2C_slave_Init
+     * @param address 7 bit address
+     * @return the device to attach on the bus
+     */
+    i2c_sim_device_t* i2c_slave_port_init(i2c_slave_port_t* port, i2c_slave_t* slave, unsigned char address);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* I2C_DEVICES_H */
+
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef I2C_SIM_H
+#define	I2C_SIM_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>        /* Includes uint16_t definition                    */
+#include <stdbool.h>       /* Includes true/false definition                  */
+
+#include "peripherals/i2c_controller.h"
+
+/******************************************************************************/
+/* System Level #define Macros                                                */
+/******************************************************************************/
+    /// Max number of devices on a simulated bus
+    #ifndef I2C_SIM_MAX_DEVICES
+    #define I2C_SIM_MAX_DEVICES 8
+    #endif
+    /// Value of TRN without a byte to send
+    #define I2C_SIM_TRN_EMPTY 0xFFFF
+    /// Pins of the bus in the registers of the pins of the model
+    #define I2C_SIM_PIN_SCL BIT_MASK(0)
+    #define I2C_SIM_PIN_SDA BIT_MASK(1)
+
+    /// Faults of the simulated bus
+    typedef enum {
+        I2C_SIM_FAULT_NONE = 0,     ///< Bus working
+        /**
+         * A device holds SDA low: every start collides until the recovery
+         * clocks the bus. The recovery leaves SCL released as input after
+         * the pulses, the model marks SCL driven when the fault starts.
+         */
+        I2C_SIM_FAULT_STUCK,
+        /// A device stretches SCL in the next operation, without end and interrupt
+        I2C_SIM_FAULT_HANG,
+        /// The next start collides with another master
+        I2C_SIM_FAULT_COLLISION,
+    } i2c_sim_fault_t;
+
+    typedef struct _i2c_sim_device i2c_sim_device_t;
+    /**
+     * Virtual slave on the bus. The device is the first member of the
+     * structure of each model, the callbacks cast it to the model.
+     */
+    struct _i2c_sim_device {
+        unsigned char address;      ///< 7 bit address
+        /// Address matched, return the ACK
+        bool (*start)(i2c_sim_device_t* device, bool read);
+        /// Byte from the master, return the ACK
+        bool (*write)(i2c_sim_device_t* device, unsigned char data);
+        /// Byte to the master
+        unsigned char (*read)(i2c_sim_device_t* device);
+        /// Stop condition, can be NULL
+        void (*stop)(i2c_sim_device_t* device);
+        /// ACK (true) or NACK of the master after a byte read, can be NULL
+        void (*ack)(i2c_sim_device_t* device, bool ack);
+    };
+
+    /// Counters of the simulated bus
+    typedef struct _i2c_sim_stats {
+        uint32_t interrupts;        ///< Interrupts of the controller
+        uint32_t starts;            ///< Start conditions
+        uint32_t restarts;          ///< Repeated start conditions
+        uint32_t stops;             ///< Stop conditions
+        uint32_t bytes_tx;          ///< Bytes from the master, with addresses
+        uint32_t bytes_rx;          ///< Bytes to the master
+        uint32_t nacks;             ///< Bytes not acknowledged from the slaves
+        uint32_t bits;              ///< Bus time in SCL periods
+        uint32_t collisions;        ///< Starts failed with a bus collision
+        uint32_t hangs;             ///< Operations without end
+    } i2c_sim_stats_t;
+
+    /**
+     * Register model of a dsPIC I2C controller in master mode. After every
+     * interrupt the model runs the operation requested in CON or TRN,
+     * updates STAT and RCV and raises the interrupt flag.
+     */
+    typedef struct _i2c_sim {
+        volatile unsigned int CON;  ///< I2C configuration register
+        volatile unsigned int STAT; ///< I2C status register
+        volatile unsigned int TRN;  ///< I2C transmission register
+        volatile unsigned int RCV;  ///< I2C reception register
+        volatile unsigned int IFS;  ///< Interrupt flag register
+        hardware_bit_t interrupt;   ///< Interrupt flag of the controller
+        i2c_sim_device_t* devices[I2C_SIM_MAX_DEVICES]; ///< Devices on the bus
+        unsigned char devices_len;  ///< Number of devices
+        i2c_sim_device_t* selected; ///< Device addressed, NULL if none
+        bool address;               ///< The next byte is an address
+        unsigned int bits_per_tick; ///< SCL periods for each kernel tick, 0 to hold the tick
+        unsigned int bits_left;     ///< SCL periods to the next kernel tick
+        REGISTER timer;             ///< Timer of the kernel tick, NULL if not moved
+        REGISTER pr_timer;          ///< Period register of the timer
+        i2c_sim_fault_t fault;      ///< Fault in progress
+        volatile unsigned int PINS_TRIS; ///< Direction of SCL and SDA, for the recovery
+        volatile unsigned int PINS_LAT; ///< Latch of SCL and SDA
+        volatile unsigned int PINS_PORT; ///< Level of SCL and SDA
+        gpio_t scl;                 ///< SCL pin on the registers of the pins
+        gpio_t sda;                 ///< SDA pin on the registers of the pins
+        i2c_sim_stats_t stats;      ///< Counters
+    } i2c_sim_t;
+
+/******************************************************************************/
+/* System Function Prototypes                                                 */
+/******************************************************************************/
+    /**
+     * Initialize an idle bus without devices
+     * @param sim the simulated controller
+     * @param bits_per_tick SCL periods for each kernel tick, 0 to hold the tick
+     */
+    void i2c_sim_init(i2c_sim_t* sim, unsigned int bits_per_tick);
+    /**
+     * Move the timer of the kernel tick with the bus time, for the
+     * measures shorter than a tick
+     * @param sim the simulated controller
+     * @param timer_register timer of the kernel tick
+     * @param pr_timer period register of the timer
+     */
+    void i2c_sim_timer(i2c_sim_t* sim, REGISTER timer_register, REGISTER pr_timer);
+    /**
+     * Start a fault on the bus
+     * @param sim the simulated controller
+     * @param fault the fault, I2C_SIM_FAULT_NONE to stop it
+     */
+    void i2c_sim_fault(i2c_sim_t* sim, i2c_sim_fault_t fault);
+    /**
+     * Connect a device on the bus
+     * @param sim the simulated controller
+     * @param device the device
+     * @return false if the bus is full
+     */
+    bool i2c_sim_attach(i2c_sim_t* sim, i2c_sim_device_t* device);
+    /**
+     * Initialize the I2C controller on the registers of the model
+     * @param sim the simulated controller
+     * @param bus context of the bus
+     * @param resetCallback additional operation when reset I2C
+     * @return Number event
+     */
+    hEvent_t i2c_sim_bus(i2c_sim_t* sim, i2c_bus_t* bus, I2C_resetFunc resetCallback);
+    /**
+     * Run the operation requested from the controller
+     * @param sim the simulated controller
+     * @return true if the operation raises the interrupt
+     */
+    bool i2c_sim_step(i2c_sim_t* sim);
+    /**
+     * Serve the interrupts until the controller is idle
+     * @param sim the simulated controller
+     * @param bus context of the bus
+     * @return number of interrupts served
+     */
+    uint32_t i2c_sim_run(i2c_sim_t* sim, i2c_bus_t* bus);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* I2C_SIM_H */
+
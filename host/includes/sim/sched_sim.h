@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef SCHED_SIM_H
+#define	SCHED_SIM_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>        /* Includes uint16_t definition                    */
+#include <stdbool.h>       /* Includes true/false definition                  */
+
+#include "system/events.h"
+#include "system/task_manager.h"
+
+/******************************************************************************/
+/* System Level #define Macros                                                */
+/******************************************************************************/
+    /// Max number of simulated jobs
+    #ifndef SCHED_SIM_MAX_JOBS
+    #define SCHED_SIM_MAX_JOBS 16
+    #endif
+    /// Releases of a job waiting for the callback
+    #define SCHED_SIM_MAX_BACKLOG 8
+
+    /**
+     * Virtual CPU. The time runs in CPU cycles: a timer interrupt every
+     * cycles_per_tick runs task_manager, the software interrupts of the
+     * event priorities run event_manager. The callbacks consume virtual
+     * cycles, so the interrupts with priority over the CPU preempt them
+     * and the others wait as on the hardware.
+     */
+    typedef struct _sched_sim_config {
+        uint32_t cycles_per_tick;   ///< CPU cycles between two timer interrupts
+        frequency_t frequency;      ///< Frequency of the task manager
+        unsigned int timer_ipl;     ///< Priority of the timer interrupt
+        unsigned int level;         ///< CPU priority of the callbacks, level of init_events
+        unsigned int event_ipl[LNG_EVENTPRIORITY]; ///< Priority of the event interrupts
+        uint32_t tick_cost;         ///< Cycles of the timer routine
+        uint32_t dispatch_cost;     ///< Cycles of an event interrupt before the callbacks
+    } sched_sim_config_t;
+
+    /// Counters of a job
+    typedef struct _sched_sim_job_stats {
+        uint32_t releases;          ///< Releases from the task manager
+        uint32_t runs;              ///< Callbacks
+        uint32_t dropped;           ///< Releases merged in a pending event
+        uint32_t overruns;          ///< Releases lost, callback still running
+        uint64_t latency_total;     ///< Sum of the cycles from release to start
+        uint32_t latency_min;       ///< Min cycles from release to start
+        uint32_t latency_max;       ///< Max cycles from release to start
+        uint64_t jitter_total;      ///< Sum of the deviation of the start period
+        uint32_t jitter_max;        ///< Max deviation of the start period
+    } sched_sim_job_stats_t;
+
+    /**
+     * Periodic job: a task of the kernel with a synthetic callback that
+     * consumes a fixed number of cycles
+     */
+    typedef struct _sched_sim_job {
+        const char* name;           ///< Name in the report
+        frequency_t frequency;      ///< Frequency of the task
+        eventPriority priority;     ///< Priority of the event, without level
+        uint32_t cost;              ///< Cycles of the callback
+        uint32_t phase;             ///< Ticks before the start of the task
+        uint8_t level;              ///< Software level of the event, 0 for the priority
+        uint32_t budget;            ///< Budget of the callback in [uS], EVENT_NO_BUDGET without
+        event_overrun_t overrun;    ///< Action after an overrun of the budget
+        uint8_t skip;               ///< Triggers dropped after an overrun
+        hEvent_t event;             ///< Event of the job
+        hTask_t task;               ///< Task of the job
+        string_data_t module;       ///< Module of the job, with the name of the job
+        uint16_t period;            ///< Ticks between two releases
+        uint16_t counter;           ///< Ticks from the last release
+        bool started;               ///< Task running
+        bool running;               ///< Callback running
+        uint64_t backlog[SCHED_SIM_MAX_BACKLOG]; ///< Releases waiting for the callback
+        unsigned char backlog_len;  ///< Number of releases waiting
+        uint64_t last_start;        ///< Cycle of the last start, 0 before the first
+        sched_sim_job_stats_t stats; ///< Counters
+    } sched_sim_job_t;
+
+    /// Counters of the virtual CPU
+    typedef struct _sched_sim_stats {
+        uint64_t cycles;            ///< Virtual time
+        uint64_t idle;              ///< Cycles without interrupts
+        uint64_t ticks;             ///< Timer interrupts
+        uint64_t lost_ticks;        ///< Timer interrupts lost, flag still set
+        uint64_t tick_delay_total;  ///< Sum of the cycles from the timer to its routine
+        uint32_t tick_delay_max;    ///< Max cycles from the timer to its routine
+        uint64_t dispatches;        ///< Event interrupts
+    } sched_sim_stats_t;
+
+/******************************************************************************/
+/* System Function Prototypes                                                 */
+/******************************************************************************/
+    /**
+     * Initialize the mock, the kernel and the virtual clock at zero
+     * @param config configuration of the CPU
+     */
+    void sched_sim_init(const sched_sim_config_t* config);
+    /**
+     * Register the event and the task of a job
+     * @param job the job, allocated from the user
+     * @return false if the kernel refuses the event or the task
+     */
+    bool sched_sim_add(sched_sim_job_t* job);
+    /**
+     * Run the virtual CPU
+     * @param ticks number of timer periods to run
+     */
+    void sched_sim_run(uint64_t ticks);
+    /**
+     * Consume cycles of the CPU, the interrupts with priority over the CPU
+     * run in the meantime. Use it in the callbacks to model their cost.
+     * @param cycles cycles to consume
+     */
+    void sched_sim_consume(uint32_t cycles);
+    /**
+     * Virtual time
+     * @return cycles from the init
+     */
+    uint64_t sched_sim_now(void);
+    /**
+     * Copy the counters of the virtual CPU
+     * @param stats destination of the counters
+     */
+    void sched_sim_get_stats(sched_sim_stats_t* stats);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* SCHED_SIM_H */
+
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+/*
+ * Host replacement of the XC16 device header. The special function
+ * registers are plain variables of the user, passed to the kernel as
+ * REGISTER; this header gives only the CPU priority and power save macros
+ * on the mock.
+ */
+
+#ifndef XC_H
+#define	XC_H
+
+#include "hal/hal.h"
+
+/******************************************************************************/
+/* System Level #define Macros                                                */
+/******************************************************************************/
+
+    /// Save the CPU priority and raise it
+    #define SET_AND_SAVE_CPU_IPL(save_to, ipl)  \
+                do {                            \
+                    (save_to) = hal_cpu_ipl;    \
+                    hal_cpu_ipl = (ipl);        \
+                } while (0)
+    /// Status register of the CPU, only the priority can be read
+    #define SRbits ((struct { unsigned int IPL; }) { hal_cpu_ipl })
+    /// Set the CPU priority and take the pending interrupts
+    #define SET_CPU_IPL(ipl)                    \
+                do {                            \
+                    hal_cpu_ipl = (ipl);        \
+                    hal_interrupt_dispatch();   \
+                } while (0)
+    /// Restore the CPU priority and take the pending interrupts
+    #define RESTORE_CPU_IPL(saved_to)           \
+                do {                            \
+                    hal_cpu_ipl = (saved_to);   \
+                    hal_interrupt_dispatch();   \
+                } while (0)
+    /// No operation
+    #define Nop() __asm__ volatile ("nop")
+    /// Power save, up to the next interrupt
+    #define Idle() hal_power_save(HAL_POWER_IDLE)
+    #define Sleep() hal_power_save(HAL_POWER_SLEEP)
+
+#endif	/* XC_H */
+
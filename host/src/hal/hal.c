@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+ */
+
+/******************************************************************************/
+/* Files to Include                                                           */
+/******************************************************************************/
+
+#include <string.h>
+
+#include "hal/hal.h"
+
+/******************************************************************************/
+/* Global Variable Declaration                                                */
+/******************************************************************************/
+
+/// Priority of the CPU
+volatile unsigned int hal_cpu_ipl = HAL_IPL_MAIN;
+/// Registered interrupts
+hal_interrupt_t hal_interrupts[HAL_MAX_INTERRUPTS];
+/// Number of registered interrupts
+unsigned short hal_interrupt_counter = 0;
+/// Power save of the host program
+hal_power_t hal_power = NULL;
+
+/*****************************************************************************/
+/* Communication Functions                                                   */
+/*****************************************************************************/
+
+void hal_init(void) {
+    memset(hal_interrupts, 0, sizeof(hal_interrupts));
+    hal_interrupt_counter = 0;
+    hal_cpu_ipl = HAL_IPL_MAIN;
+    hal_power = NULL;
+}
+
+bool hal_interrupt_register(hardware_bit_t* flag, unsigned int ipl, hal_isr_t isr) {
+    hal_interrupt_t* interrupt;
+    if (hal_interrupt_counter >= HAL_MAX_INTERRUPTS || ipl == HAL_IPL_MAIN || ipl > HAL_IPL_MAX) {
+        return false;
+    }
+    interrupt = &hal_interrupts[hal_interrupt_counter++];
+    interrupt->flag = flag;
+    interrupt->ipl = ipl;
+    interrupt->isr = isr;
+    interrupt->count = 0;
+    return true;
+}
+
+void hal_interrupt_dispatch(void) {
+    hal_interrupt_t* pending;
+    unsigned int saved;
+    unsigned short i;
+    for (;;) {
+        // The pending interrupt with the highest priority over the CPU
+        pending = NULL;
+        for (i = 0; i < hal_interrupt_counter; ++i) {
+            if (REGISTER_MASK_READ(hal_interrupts[i].flag->REG, hal_interrupts[i].flag->CS_mask)
+                    && hal_interrupts[i].ipl > hal_cpu_ipl
+                    && (pending == NULL || hal_interrupts[i].ipl > pending->ipl)) {
+                pending = &hal_interrupts[i];
+            }
+        }
+        if (pending == NULL) {
+            return;
+        }
+        REGISTER_MASK_SET_LOW(pending->flag->REG, pending->flag->CS_mask);
+        saved = hal_cpu_ipl;
+        hal_cpu_ipl = pending->ipl;
+        pending->count++;
+        pending->isr();
+        hal_cpu_ipl = saved;
+    }
+}
+
+uint32_t hal_interrupt_count(hardware_bit_t* flag) {
+    unsigned short i;
+    for (i = 0; i < hal_interrupt_counter; ++i) {
+        if (hal_interrupts[i].flag == flag) {
+            return hal_interrupts[i].count;
+        }
+    }
+    return 0;
+}
+
+void hal_power_register(hal_power_t power) {
+    hal_power = power;
+}
+
+void hal_power_save(unsigned int mode) {
+    if (hal_power != NULL) {
+        hal_power(mode);
+    }
+    hal_interrupt_dispatch();
+}
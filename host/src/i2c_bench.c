@@ -0,0 +1,435 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+ */
+
+/******************************************************************************/
+/* Files to Include                                                           */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hal/hal.h"
+#include "sim/i2c_sim.h"
+#include "sim/i2c_devices.h"
+#include "system/task_manager.h"
+#include "system/snapshot.h"
+
+/// Address of the virtual EEPROM
+#define BENCH_EEPROM_ADDRESS 0x50
+/// Bus time of a kernel tick: 1 kHz tick with 100 kHz SCL
+#define BENCH_BITS_PER_TICK 100
+/// Default number of samples of each scenario
+#define BENCH_SAMPLES 10000
+/// Frequency of the kernel
+#define BENCH_FREQ_MCU 40000000
+#define BENCH_FREQ_TIMER 1000
+/// Address of the slave of the kernel
+#define BENCH_SLAVE_ADDRESS 0x20
+/// First register and number of registers of the slave
+#define BENCH_SLAVE_REG 0x10
+#define BENCH_SLAVE_SIZE 8
+/// Max ticks of a transaction in the fault scenarios
+#define BENCH_TIMEOUT 2
+/// Max ticks to wait the end of a fault scenario
+#define BENCH_WAIT_TICKS 100
+
+/// Results of a scenario
+typedef struct _bench_result {
+    uint32_t completed;         ///< Requests completed
+    uint32_t failed;            ///< Requests failed
+    uint32_t bytes;             ///< Data bytes from the callbacks
+} bench_result_t;
+
+/******************************************************************************/
+/* Global Variable Declaration                                                */
+/******************************************************************************/
+
+/// Registers of the timer and flag of the software interrupt
+volatile unsigned int TMR1, PR1, IFS3;
+hardware_bit_t bench_low_flag = REGISTER_INIT(IFS3, 0);
+
+i2c_sim_t sim;
+i2c_bus_t bus;
+i2c_eeprom_t eeprom;
+i2c_regmap_t imu;
+i2c_slave_t slave;
+i2c_slave_port_t slave_port;
+unsigned char slave_regs[BENCH_SLAVE_SIZE];
+const i2c_slave_region_t slave_regions[] = {
+    I2C_SLAVE_REGION(BENCH_SLAVE_REG, slave_regs, I2C_SLAVE_WRITABLE),
+};
+/// Registers notified from the write callback of the slave
+unsigned char slave_first;
+unsigned int slave_size;
+
+/*****************************************************************************/
+/* Communication Functions                                                   */
+/*****************************************************************************/
+
+static void bench_reset(bool state) {
+}
+
+static void bench_low_isr(void) {
+    event_manager(EVENT_PRIORITY_LOW);
+}
+
+static void bench_done(hI2C_t request, bool state, unsigned int bytes, void* context) {
+    bench_result_t* result = (bench_result_t*) context;
+    if (state) {
+        result->completed++;
+    } else {
+        result->failed++;
+    }
+    result->bytes += bytes;
+}
+
+static void bench_slave_written(i2c_slave_t* slave, unsigned char reg, unsigned int size) {
+    slave_first = reg;
+    slave_size = size;
+}
+
+static uint64_t bench_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+/**
+ * New bus with an EEPROM and an IMU
+ */
+static void bench_setup(void) {
+    hal_init();
+    TMR1 = 0;
+    PR1 = BENCH_FREQ_MCU / BENCH_FREQ_TIMER - 1;
+    init_events(&TMR1, &PR1, BENCH_FREQ_MCU, HAL_IPL_MAX);
+    register_interrupt(EVENT_PRIORITY_LOW, &bench_low_flag);
+    hal_interrupt_register(&bench_low_flag, 1, &bench_low_isr);
+    task_init(BENCH_FREQ_TIMER);
+    i2c_sim_init(&sim, BENCH_BITS_PER_TICK);
+    i2c_sim_timer(&sim, &TMR1, &PR1);
+    i2c_sim_attach(&sim, i2c_eeprom_init(&eeprom, BENCH_EEPROM_ADDRESS, I2C_EEPROM_MAX_SIZE));
+    i2c_sim_attach(&sim, i2c_imu_init(&imu, I2C_IMU_ADDRESS));
+    i2c_sim_bus(&sim, &bus, &bench_reset);
+}
+/**
+ * Print a row of results, the transactions are the completed requests
+ */
+static void bench_print(const char* name, bench_result_t* result, uint64_t ns) {
+    uint32_t transactions = result->completed + result->failed;
+    if (transactions == 0) {
+        transactions = 1;
+    }
+    printf("%-12s %8u %6u %8.2f %8u %8u %8u %8.1f %8.1f %8.1f %8u %8.1f\n", name,
+            result->completed, result->failed,
+            (double) sim.stats.interrupts / transactions,
+            sim.stats.starts, sim.stats.restarts, sim.stats.stops,
+            (double) sim.stats.bits / transactions,
+            (double) result->bytes / transactions,
+            (double) ns / transactions,
+            bus.stats.queue_wait.max,
+            (double) bus.stats.bus_time.total / transactions);
+}
+/**
+ * Read a full sample from the IMU, one request at a time
+ */
+static void bench_imu_single(uint32_t samples) {
+    bench_result_t result = {0};
+    unsigned char reg = I2C_IMU_ACCEL_XOUT_H;
+    unsigned char data[I2C_IMU_SAMPLE_SIZE];
+    uint64_t start;
+    uint32_t i;
+    bench_setup();
+    start = bench_now();
+    for (i = 0; i < samples; ++i) {
+        I2C_Read(&bus, I2C_IMU_ADDRESS << 1, &reg, 1, data, I2C_IMU_SAMPLE_SIZE, &bench_done, &result);
+        i2c_sim_run(&sim, &bus);
+    }
+    bench_print("imu_single", &result, bench_now() - start);
+}
+/**
+ * Fill the queue with reads and serve all of them
+ */
+static void bench_imu_queued(uint32_t samples) {
+    bench_result_t result = {0};
+    unsigned char reg = I2C_IMU_ACCEL_XOUT_H;
+    unsigned char data[I2C_QUEUE_DEPTH][I2C_IMU_SAMPLE_SIZE];
+    uint64_t start;
+    uint32_t i;
+    unsigned int j;
+    bench_setup();
+    start = bench_now();
+    for (i = 0; i < samples; i += I2C_QUEUE_DEPTH) {
+        for (j = 0; j < I2C_QUEUE_DEPTH; ++j) {
+            I2C_Read(&bus, I2C_IMU_ADDRESS << 1, &reg, 1, data[j], I2C_IMU_SAMPLE_SIZE, &bench_done, &result);
+        }
+        i2c_sim_run(&sim, &bus);
+    }
+    bench_print("imu_queued", &result, bench_now() - start);
+}
+/**
+ * Accelerometer and gyroscope with two requests
+ */
+static void bench_imu_split(uint32_t samples) {
+    bench_result_t result = {0};
+    unsigned char accel = I2C_IMU_ACCEL_XOUT_H;
+    unsigned char gyro = I2C_IMU_GYRO_XOUT_H;
+    unsigned char data[12];
+    uint64_t start;
+    uint32_t i;
+    bench_setup();
+    start = bench_now();
+    for (i = 0; i < samples; ++i) {
+        I2C_Read(&bus, I2C_IMU_ADDRESS << 1, &accel, 1, data, 6, &bench_done, &result);
+        I2C_Read(&bus, I2C_IMU_ADDRESS << 1, &gyro, 1, data + 6, 6, &bench_done, &result);
+        i2c_sim_run(&sim, &bus);
+    }
+    bench_print("imu_split", &result, bench_now() - start);
+}
+/**
+ * Accelerometer and gyroscope in a single transaction
+ */
+static void bench_imu_batch(uint32_t samples) {
+    bench_result_t result = {0};
+    unsigned char accel = I2C_IMU_ACCEL_XOUT_H;
+    unsigned char gyro = I2C_IMU_GYRO_XOUT_H;
+    unsigned char data[12];
+    i2c_segment_t segments[4] = {
+        {I2C_IMU_ADDRESS << 1, I2C_SEGMENT_WRITE, &accel, 1},
+        {I2C_IMU_ADDRESS << 1, I2C_SEGMENT_READ, data, 6},
+        {I2C_IMU_ADDRESS << 1, I2C_SEGMENT_WRITE, &gyro, 1},
+        {I2C_IMU_ADDRESS << 1, I2C_SEGMENT_READ, data + 6, 6},
+    };
+    uint64_t start;
+    uint32_t i;
+    bench_setup();
+    start = bench_now();
+    for (i = 0; i < samples; ++i) {
+        I2C_Transaction(&bus, segments, 4, &bench_done, &result);
+        i2c_sim_run(&sim, &bus);
+    }
+    bench_print("imu_batch", &result, bench_now() - start);
+}
+/**
+ * Write a page of the EEPROM and read it back
+ * @return false if the data read is different
+ */
+static bool bench_eeprom(uint32_t samples) {
+    bench_result_t result = {0};
+    unsigned char address[2];
+    unsigned char page[I2C_EEPROM_PAGE];
+    unsigned char check[I2C_EEPROM_PAGE];
+    uint64_t start;
+    uint32_t i;
+    unsigned int j;
+    uint16_t pointer;
+    bool valid = true;
+    bench_setup();
+    start = bench_now();
+    for (i = 0; i < samples; ++i) {
+        pointer = (i * I2C_EEPROM_PAGE) % eeprom.size;
+        address[0] = pointer >> 8;
+        address[1] = pointer & 0xFF;
+        for (j = 0; j < I2C_EEPROM_PAGE; ++j) {
+            page[j] = (unsigned char) (i + j);
+        }
+        I2C_Write_data(&bus, BENCH_EEPROM_ADDRESS << 1, address, 2, page, I2C_EEPROM_PAGE, &bench_done, &result);
+        I2C_Read(&bus, BENCH_EEPROM_ADDRESS << 1, address, 2, check, I2C_EEPROM_PAGE, &bench_done, &result);
+        i2c_sim_run(&sim, &bus);
+        if (memcmp(page, check, I2C_EEPROM_PAGE) != 0) {
+            valid = false;
+        }
+    }
+    bench_print("eeprom", &result, bench_now() - start);
+    return valid;
+}
+/**
+ * Read the identity of a missing and of a present device
+ * @return false if the answers are wrong
+ */
+static bool bench_identity(void) {
+    bench_result_t result = {0};
+    unsigned char reg = I2C_IMU_WHO_AM_I;
+    unsigned char who = 0;
+    bench_setup();
+    I2C_Read(&bus, 0x10 << 1, &reg, 1, &who, 1, &bench_done, &result);
+    I2C_Read(&bus, I2C_IMU_ADDRESS << 1, &reg, 1, &who, 1, &bench_done, &result);
+    i2c_sim_run(&sim, &bus);
+    bench_print("identity", &result, 0);
+    return result.failed == 1 && who == I2C_IMU_ADDRESS && bus.stats.nacks == 1;
+}
+/**
+ * Enable the timeout and the recovery on the pins of the simulator
+ * @param retries max retries of a transaction
+ */
+static void bench_recovery(unsigned char retries) {
+    i2c_recovery_t recovery;
+    recovery.scl = &sim.scl;
+    recovery.sda = &sim.sda;
+    recovery.timeout = BENCH_TIMEOUT;
+    recovery.policy = I2C_RECOVERY_RETRY;
+    recovery.retries = retries;
+    I2C_setRecovery(&bus, &recovery, BENCH_FREQ_TIMER);
+}
+/**
+ * Run the bus and the kernel until the end of all requests
+ * @param result results of the scenario
+ * @param requests number of requests submitted
+ */
+static void bench_wait(bench_result_t* result, uint32_t requests) {
+    unsigned int ticks;
+    for (ticks = 0; ticks < BENCH_WAIT_TICKS && result->completed + result->failed < requests; ++ticks) {
+        i2c_sim_run(&sim, &bus);
+        task_manager();
+        hal_interrupt_dispatch();
+    }
+}
+/**
+ * A peripheral holds SDA low: the retries collide, the reset clears the
+ * bus and the next request completes
+ * @return false if the recovery is wrong
+ */
+static bool bench_stuck(void) {
+    bench_result_t result = {0};
+    unsigned char reg = I2C_IMU_WHO_AM_I;
+    unsigned char who = 0;
+    bench_setup();
+    bench_recovery(2);
+    i2c_sim_fault(&sim, I2C_SIM_FAULT_STUCK);
+    I2C_Read(&bus, I2C_IMU_ADDRESS << 1, &reg, 1, &who, 1, &bench_done, &result);
+    I2C_Read(&bus, I2C_IMU_ADDRESS << 1, &reg, 1, &who, 1, &bench_done, &result);
+    bench_wait(&result, 2);
+    bench_print("stuck", &result, 0);
+    return result.failed == 1 && result.completed == 1 && who == I2C_IMU_ADDRESS
+            && bus.stats.collisions == 3 && bus.stats.retries == 2 && bus.stats.resets == 1
+            && bus.stats.timeouts == 0 && sim.fault == I2C_SIM_FAULT_NONE;
+}
+/**
+ * A peripheral stretches the clock without end: the watchdog resets the
+ * bus after the timeout and the transaction is retried
+ * @return false if the recovery is wrong
+ */
+static bool bench_timeout(void) {
+    bench_result_t result = {0};
+    unsigned char reg = I2C_IMU_WHO_AM_I;
+    unsigned char who = 0;
+    bench_setup();
+    bench_recovery(1);
+    i2c_sim_fault(&sim, I2C_SIM_FAULT_HANG);
+    I2C_Read(&bus, I2C_IMU_ADDRESS << 1, &reg, 1, &who, 1, &bench_done, &result);
+    bench_wait(&result, 1);
+    bench_print("timeout", &result, 0);
+    return result.completed == 1 && who == I2C_IMU_ADDRESS && sim.stats.hangs == 1
+            && bus.stats.timeouts == 1 && bus.stats.resets == 1 && bus.stats.retries == 1;
+}
+/**
+ * Another master wins the arbitration: the transaction is retried
+ * without reset
+ * @return false if the recovery is wrong
+ */
+static bool bench_collision(void) {
+    bench_result_t result = {0};
+    unsigned char reg = I2C_IMU_WHO_AM_I;
+    unsigned char who = 0;
+    bench_setup();
+    bench_recovery(1);
+    i2c_sim_fault(&sim, I2C_SIM_FAULT_COLLISION);
+    I2C_Read(&bus, I2C_IMU_ADDRESS << 1, &reg, 1, &who, 1, &bench_done, &result);
+    bench_wait(&result, 1);
+    bench_print("collision", &result, 0);
+    return result.completed == 1 && who == I2C_IMU_ADDRESS && bus.stats.collisions == 1
+            && bus.stats.retries == 1 && bus.stats.resets == 0 && bus.stats.timeouts == 0;
+}
+/**
+ * Write the registers of a slave of the kernel and read them back
+ * @return false if the data or the notification are wrong
+ */
+static bool bench_slave(void) {
+    bench_result_t result = {0};
+    i2c_slave_stats_t stats;
+    unsigned char reg = BENCH_SLAVE_REG;
+    unsigned char data[BENCH_SLAVE_SIZE / 2] = {0x12, 0x34, 0x56, 0x78};
+    unsigned char check[BENCH_SLAVE_SIZE / 2] = {0};
+    bench_setup();
+    i2c_sim_attach(&sim, i2c_slave_port_init(&slave_port, &slave, BENCH_SLAVE_ADDRESS));
+    I2C_slave_map(&slave, slave_regions, 1, NULL, &bench_slave_written);
+    memset(slave_regs, 0, sizeof(slave_regs));
+    slave_first = slave_size = 0;
+    I2C_Write_data(&bus, BENCH_SLAVE_ADDRESS << 1, &reg, 1, data, sizeof(data), &bench_done, &result);
+    I2C_Read(&bus, BENCH_SLAVE_ADDRESS << 1, &reg, 1, check, sizeof(check), &bench_done, &result);
+    i2c_sim_run(&sim, &bus);
+    hal_interrupt_dispatch();
+    bench_print("slave", &result, 0);
+    I2C_slave_getStats(&slave, &stats);
+    return result.completed == 2 && memcmp(data, slave_regs, sizeof(data)) == 0
+            && memcmp(data, check, sizeof(data)) == 0
+            && slave_first == BENCH_SLAVE_REG && slave_size == sizeof(data)
+            && stats.reads == 1 && stats.bytes_tx == sizeof(check) && stats.rejected == 0;
+}
+
+/**
+ * Write the state of the kernel and of the bus in i2c.snap
+ */
+static void bench_snapshot(void) {
+    static uint8_t data[1024];
+    FILE* file;
+    size_t size = snapshot_take(data, sizeof(data));
+    if (size == 0) {
+        fprintf(stderr, "i2c_bench: snapshot too large\n");
+        return;
+    }
+    file = fopen("i2c.snap", "wb");
+    if (file == NULL || fwrite(data, 1, size, file) != size) {
+        fprintf(stderr, "i2c_bench: can not write i2c.snap\n");
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+}
+
+int main(int argc, char** argv) {
+    uint32_t samples = BENCH_SAMPLES;
+    bool valid = true;
+    bool snapshot = false;
+    if (argc > 1) {
+        samples = strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2 && strcmp(argv[2], "snapshot") == 0) {
+        snapshot = true;
+        snapshot_register(&I2C_snapshot, &bus);
+    }
+    printf("# %-10s %8s %6s %8s %8s %8s %8s %8s %8s %8s %8s %8s\n", "scenario", "done", "failed",
+            "irq/tr", "starts", "restart", "stops", "bits/tr", "bytes/tr", "ns/tr", "wait_us", "bus_us");
+    valid &= bench_identity();
+    bench_imu_single(samples);
+    bench_imu_queued(samples);
+    bench_imu_split(samples);
+    bench_imu_batch(samples);
+    valid &= bench_eeprom(samples);
+    valid &= bench_stuck();
+    valid &= bench_timeout();
+    valid &= bench_collision();
+    valid &= bench_slave();
+    if (snapshot) {
+        bench_snapshot();
+    }
+    if (!valid) {
+        fprintf(stderr, "i2c_bench: wrong data from the simulated devices\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
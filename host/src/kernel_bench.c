@@ -0,0 +1,534 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+ */
+
+/*
+ * Cost of each call of the hot paths of the kernel. The tables of events
+ * and tasks are sized at build time, "make -C host bench" builds the
+ * kernel for each size of BENCH_SIZES; leds, GPIO ports and buffers are
+ * sized at run time.
+ *
+ *     kernel_bench [tables|io|all] [work]
+ */
+
+/******************************************************************************/
+/* Files to Include                                                           */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "hal/hal.h"
+#include "data/data.h"
+#include "peripherals/gpio.h"
+#include "peripherals/led.h"
+#include "system/soft_timer.h"
+#include "system/task_manager.h"
+#include "system/critical.h"
+#include "system/topic.h"
+#include "system/mailbox.h"
+
+/// Size of the tables, the defaults of events.c and task_manager.c
+#ifndef MAX_EVENTS
+#define MAX_EVENTS 16
+#endif
+#ifndef MAX_TASKS
+#define MAX_TASKS 16
+#endif
+/// Default number of elements (events, leds, bytes) processed in each bench
+#define BENCH_WORK 20000000UL
+/// Min number of calls of each bench
+#define BENCH_MIN_CALLS 1000
+/// Frequency of the kernel
+#define BENCH_FREQ_MCU 40000000
+#define BENCH_FREQ_TIMER 1000
+/// Max number of leds and bytes of the run time sweep
+#define BENCH_MAX_SIZE 1024
+/// Leds for each port of 16 bits
+#define BENCH_LED_PORTS (BENCH_MAX_SIZE / 16)
+/// Slots of the mailbox in the check of the order, over 128 to wrap a byte
+#define BENCH_MAILBOX_DEPTH 200
+
+/// Start of a measure, in host time and in cycles of the counter
+typedef struct _bench_clock {
+    uint64_t ns;
+    uint64_t cycles;
+} bench_clock_t;
+
+/******************************************************************************/
+/* Global Variable Declaration                                                */
+/******************************************************************************/
+
+/// Registers of the timer, of the software interrupt and of the GPIO
+volatile unsigned int TMR1, PR1, IFS3, AD1PCFGL, IEC0;
+volatile unsigned int TRIS[BENCH_LED_PORTS], PORT[BENCH_LED_PORTS], LAT[BENCH_LED_PORTS];
+hardware_bit_t bench_low_flag = REGISTER_INIT(IFS3, 0);
+hardware_bit_t bench_irq_enable = REGISTER_INIT(IEC0, 3);
+
+/// Elements processed in each bench
+unsigned long bench_work = BENCH_WORK;
+/// Callbacks executed and results of the calls, to keep them alive
+volatile unsigned long bench_callbacks, bench_sink;
+/// False after a wrong result of the kernel
+bool bench_valid = true;
+
+led_control_t bench_leds[BENCH_MAX_SIZE];
+gp_peripheral_t bench_pins[16];
+gp_port_def_t bench_port = {bench_pins, 0};
+unsigned char bench_source[BENCH_MAX_SIZE], bench_destination[BENCH_MAX_SIZE];
+
+/*****************************************************************************/
+/* Communication Functions                                                   */
+/*****************************************************************************/
+
+static inline void bench_start(bench_clock_t* clock) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    clock->ns = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+#if defined(__x86_64__) || defined(__i386__)
+    clock->cycles = __rdtsc();
+#else
+    clock->cycles = 0;
+#endif
+}
+/**
+ * Print a row: function, parameter and size of the bench, calls, host time
+ * and cycles of the time stamp counter for each call (0 without counter)
+ */
+static void bench_print(const char* function, const char* param, unsigned long size,
+        unsigned long calls, const bench_clock_t* start) {
+    bench_clock_t stop;
+    bench_start(&stop);
+    printf("%-20s %-10s %6lu %6u %6u %10lu %10.1f %10.1f\n", function, param, size,
+            MAX_EVENTS, MAX_TASKS, calls,
+            (double) (stop.ns - start->ns) / calls,
+            (double) (stop.cycles - start->cycles) / calls);
+}
+/**
+ * Number of calls of a bench that processes size elements each call
+ */
+static unsigned long bench_calls(unsigned long size) {
+    unsigned long calls = bench_work / (size > 0 ? size : 1);
+    return calls < BENCH_MIN_CALLS ? BENCH_MIN_CALLS : calls;
+}
+
+static void bench_callback(int argc, event_arg_t* argv) {
+    bench_callbacks++;
+}
+/**
+ * Kernel with a software interrupt for each priority, without events and
+ * tasks
+ */
+static void bench_setup(void) {
+    hal_init();
+    init_events(&TMR1, &PR1, BENCH_FREQ_MCU, HAL_IPL_MAX);
+    register_interrupt(EVENT_PRIORITY_LOW, &bench_low_flag);
+    task_init(BENCH_FREQ_TIMER);
+}
+/**
+ * Fill the table of events
+ * @param events handles of the events
+ * @return number of events registered
+ */
+static unsigned int bench_fill_events(hEvent_t* events) {
+    unsigned int i;
+    for (i = 0; i < MAX_EVENTS; ++i) {
+        events[i] = register_event_p(INVALID_MODULE_HANDLE, &bench_callback, EVENT_PRIORITY_LOW);
+        if (events[i] == INVALID_EVENT_HANDLE) {
+            break;
+        }
+    }
+    return i;
+}
+/**
+ * Trigger of an event and dispatch of a full table of events
+ */
+static void bench_events(void) {
+    static hEvent_t events[MAX_EVENTS];
+    static event_arg_t argv[2];
+    bench_clock_t start;
+    unsigned long calls, i;
+    unsigned int n, j;
+    bench_setup();
+    n = bench_fill_events(events);
+
+    calls = bench_calls(1);
+    bench_start(&start);
+    for (i = 0; i < calls; ++i) {
+        trigger_event_data(events[i % n], 2, argv);
+    }
+    bench_print("trigger_event_data", "-", n, calls, &start);
+    // Reset the events pending
+    event_manager(EVENT_PRIORITY_LOW);
+
+    calls = bench_calls(n);
+    bench_start(&start);
+    for (i = 0; i < calls; ++i) {
+        event_manager(EVENT_PRIORITY_LOW);
+    }
+    bench_print("event_manager", "idle", n, calls, &start);
+
+    bench_start(&start);
+    for (i = 0; i < calls; ++i) {
+        trigger_event_data(events[n - 1], 0, NULL);
+        event_manager(EVENT_PRIORITY_LOW);
+    }
+    bench_print("event_manager", "last", n, calls, &start);
+
+    bench_start(&start);
+    for (i = 0; i < calls; ++i) {
+        for (j = 0; j < n; ++j) {
+            trigger_event_data(events[j], 0, NULL);
+        }
+        event_manager(EVENT_PRIORITY_LOW);
+    }
+    bench_print("event_manager", "all", n, calls, &start);
+}
+/**
+ * Tick of a full table of tasks and load in the last free slot
+ */
+static void bench_tasks(void) {
+    static hEvent_t events[MAX_EVENTS];
+    bench_clock_t start;
+    unsigned long calls, i;
+    unsigned int n, j;
+    hTask_t task;
+    bench_setup();
+    n = bench_fill_events(events);
+
+    for (j = 0; j + 1 < MAX_TASKS; ++j) {
+        task_load(events[j % n], BENCH_FREQ_TIMER);
+    }
+    calls = bench_calls(MAX_TASKS);
+    bench_start(&start);
+    for (i = 0; i < calls; ++i) {
+        task = task_load_data(events[0], BENCH_FREQ_TIMER, 1, (event_arg_t) i);
+        task_unload(task);
+    }
+    bench_print("task_load_data", "last", MAX_TASKS, calls, &start);
+
+    // All tasks running, one release each ten ticks
+    task_load(events[0], BENCH_FREQ_TIMER);
+    for (j = 0; j < MAX_TASKS; ++j) {
+        task_set_frequency(j, BENCH_FREQ_TIMER / 10);
+        task_set(j, RUN);
+    }
+    bench_start(&start);
+    for (i = 0; i < calls; ++i) {
+        task_manager();
+    }
+    bench_print("task_manager", "run", MAX_TASKS, calls, &start);
+
+    for (j = 0; j < MAX_TASKS; ++j) {
+        task_set(j, STOP);
+    }
+    bench_start(&start);
+    for (i = 0; i < calls; ++i) {
+        task_manager();
+    }
+    bench_print("task_manager", "stop", MAX_TASKS, calls, &start);
+}
+/**
+ * Soft timer, copy of a buffer with the interrupt enabled and critical
+ * sections without and with the measure
+ */
+static void bench_data(void) {
+    soft_timer_t timer;
+    critical_t section;
+    bench_clock_t start;
+    unsigned long calls, i;
+    unsigned int size;
+    unsigned int expired = 0;
+
+    init_soft_timer(&timer, BENCH_FREQ_TIMER, 1000000);
+    calls = bench_calls(1);
+    bench_start(&start);
+    for (i = 0; i < calls; ++i) {
+        expired += run_timer(&timer);
+    }
+    bench_sink = expired;
+    bench_print("run_timer", "-", 1, calls, &start);
+
+    REGISTER_MASK_SET_HIGH(bench_irq_enable.REG, bench_irq_enable.CS_mask);
+    for (size = 4; size <= BENCH_MAX_SIZE; size *= 4) {
+        calls = bench_calls(size);
+        bench_start(&start);
+        for (i = 0; i < calls; ++i) {
+            protectedMemcpy(&bench_irq_enable, bench_destination, bench_source, size);
+        }
+        bench_print("protectedMemcpy", "bytes", size, calls, &start);
+    }
+
+    calls = bench_calls(1);
+    bench_start(&start);
+    for (i = 0; i < calls; ++i) {
+        critical_enter(&section, NULL, CRITICAL_ALL);
+        critical_exit(&section);
+    }
+    bench_print("critical", "plain", 1, calls, &start);
+    critical_init(&TMR1, &PR1);
+    bench_start(&start);
+    for (i = 0; i < calls; ++i) {
+        CRITICAL_ENTER(section, CRITICAL_ALL);
+        CRITICAL_EXIT(section);
+    }
+    bench_print("critical", "measured", 1, calls, &start);
+    critical_init(NULL, NULL);
+}
+/**
+ * Read and write of a GPIO port, half inputs and half outputs. The port
+ * value is a word, the width is up to 16 bits.
+ */
+static void bench_gpio(void) {
+    bench_clock_t start;
+    gpio_port_t port;
+    unsigned long calls, i;
+    unsigned int width, j;
+    for (width = 4; width <= 16; width *= 2) {
+        for (j = 0; j < width; ++j) {
+            bench_pins[j].gpio.CS_TRIS = &TRIS[0];
+            bench_pins[j].gpio.CS_PORT = &PORT[0];
+            bench_pins[j].gpio.CS_LAT = &LAT[0];
+            bench_pins[j].gpio.CS_mask = BIT_MASK(j);
+            bench_pins[j].gpio.type = (j & 1) ? GPIO_OUTPUT : GPIO_INPUT;
+            bench_pins[j].common.analog = GPIO_NO_PERIPHERAL;
+        }
+        bench_port.len = width;
+        gpio_init(NULL, NULL, &AD1PCFGL, NULL, 1, &bench_port);
+
+        calls = bench_calls(width);
+        bench_start(&start);
+        for (i = 0; i < calls; ++i) {
+            port = gpio_get(0);
+            bench_sink += port.port;
+        }
+        bench_print("gpio_get", "width", width, calls, &start);
+
+        bench_start(&start);
+        for (i = 0; i < calls; ++i) {
+            port.port = (int16_t) i;
+            gpio_set(0, port);
+        }
+        bench_print("gpio_set", "width", width, calls, &start);
+    }
+}
+/**
+ * Controller of the leds, 16 leds for each port. With all leds at full
+ * brightness the controller works only at the start of a slot; dimmed,
+ * it runs the PWM at each call.
+ */
+static void bench_led(void) {
+    bench_clock_t start;
+    unsigned long calls, i;
+    unsigned int len, j;
+    for (len = 4; len <= BENCH_MAX_SIZE; len *= 4) {
+        bench_setup();
+        for (j = 0; j < len; ++j) {
+            bench_leds[j].gpio.CS_TRIS = &TRIS[j / 16];
+            bench_leds[j].gpio.CS_PORT = &PORT[j / 16];
+            bench_leds[j].gpio.CS_LAT = &LAT[j / 16];
+            bench_leds[j].gpio.CS_mask = BIT_MASK(j % 16);
+            bench_leds[j].gpio.type = GPIO_OUTPUT;
+        }
+        LED_Init(BENCH_FREQ_TIMER, bench_leds, len);
+        for (j = 0; j < len; ++j) {
+            LED_updateBlink(bench_leds, j, (j % LED_PATTERN_MAX_BLINK) + 1);
+        }
+
+        calls = bench_calls(len);
+        bench_start(&start);
+        for (i = 0; i < calls; ++i) {
+            LED_blinkController(bench_leds, len);
+        }
+        bench_print("LED_blinkController", "blink", len, calls, &start);
+
+        for (j = 0; j < len; ++j) {
+            LED_setBrightness(bench_leds, j, LED_BRIGHTNESS_MAX / 2);
+        }
+        bench_start(&start);
+        for (i = 0; i < calls; ++i) {
+            LED_blinkController(bench_leds, len);
+        }
+        bench_print("LED_blinkController", "dimmed", len, calls, &start);
+    }
+}
+
+static void bench_topic_callback(hTopic_t topic, const void* data, size_t size) {
+    bench_callbacks += ((const unsigned char*) data)[0] + size;
+}
+/**
+ * Publish of a message to up to 8 subscribers and dispatch of the callbacks
+ */
+static void bench_topics(void) {
+    bench_clock_t start;
+    unsigned long calls, i;
+    unsigned int subscribers, j;
+    hTopic_t topic;
+    unsigned char* data;
+    for (subscribers = 1; subscribers <= 8; subscribers *= 2) {
+        bench_setup();
+        topic_init();
+        topic = topic_register(INVALID_MODULE_HANDLE);
+        for (j = 0; j < subscribers; ++j) {
+            topic_subscribe(topic, INVALID_MODULE_HANDLE, &bench_topic_callback, EVENT_PRIORITY_LOW);
+        }
+        calls = bench_calls(subscribers);
+        bench_start(&start);
+        for (i = 0; i < calls; ++i) {
+            data = topic_alloc();
+            data[0] = i;
+            topic_publish(topic, data, TOPIC_BUFFER_SIZE);
+            event_manager(EVENT_PRIORITY_LOW);
+        }
+        bench_print("topic_publish", "subs", subscribers, calls, &start);
+        if (topic_free_buffers() != TOPIC_BUFFERS) {
+            fprintf(stderr, "kernel_bench: topic buffers not released\n");
+            bench_valid = false;
+        }
+    }
+}
+
+/**
+ * Lookup of the names of a full table of modules
+ */
+static void bench_modules(void) {
+    static char names[MAX_MODULES][8];
+    static string_data_t strings[MAX_MODULES];
+    bench_clock_t start;
+    unsigned long calls, i;
+    unsigned int j;
+    init_modules();
+    for (j = 0; j < MAX_MODULES; ++j) {
+        snprintf(names[j], sizeof(names[j]), "mod%u", j);
+        strings[j].string = names[j];
+        strings[j].len = strlen(names[j]) + 1;
+        register_module(&strings[j]);
+    }
+    calls = bench_calls(1);
+    bench_start(&start);
+    for (i = 0; i < calls; ++i) {
+        bench_sink += module_find(names[i % MAX_MODULES]);
+    }
+    bench_print("module_find", "-", MAX_MODULES, calls, &start);
+}
+
+static void bench_mailbox_callback(hEvent_t hEvent, const void* message) {
+    bench_callbacks += ((const unsigned char*) message)[0];
+}
+
+/// Next message expected from the mailbox and messages out of order
+uint16_t bench_mailbox_next;
+unsigned int bench_mailbox_errors;
+
+static void bench_mailbox_order(hEvent_t hEvent, const void* message) {
+    uint16_t sequence;
+    memcpy(&sequence, message, sizeof(sequence));
+    if (sequence != bench_mailbox_next) {
+        bench_mailbox_errors++;
+    }
+    bench_mailbox_next = sequence + 1;
+}
+/**
+ * Order and content of the messages with the ring of a deep mailbox over
+ * the end of the slots
+ * @return true if the messages arrive in order of post
+ */
+static bool bench_mailbox_wrap(void) {
+    static uint16_t slots[BENCH_MAILBOX_DEPTH];
+    mailbox_t box;
+    critical_t section;
+    uint16_t sequence = 0;
+    unsigned int round, i;
+    bench_setup();
+    mailbox_init(&box, slots, sizeof(uint16_t), BENCH_MAILBOX_DEPTH, INVALID_MODULE_HANDLE,
+            &bench_mailbox_order, EVENT_PRIORITY_LOW);
+    bench_mailbox_next = 0;
+    bench_mailbox_errors = 0;
+    // The head moves at 150 and 100, the posts wrap at each round; the
+    // software interrupt delivers at the end of the section
+    for (round = 0; round < 4; ++round) {
+        CRITICAL_ENTER(section, CRITICAL_ALL);
+        for (i = 0; i < 150; ++i, ++sequence) {
+            mailbox_post(&box, &sequence, sizeof(sequence));
+        }
+        CRITICAL_EXIT(section);
+        event_manager(EVENT_PRIORITY_LOW);
+    }
+    return bench_mailbox_errors == 0 && bench_mailbox_next == sequence && mailbox_lost(&box) == 0;
+}
+/**
+ * Posts of messages of 4 to 64 bytes in a mailbox of 8 slots and dispatch
+ * of the callbacks
+ */
+static void bench_mailbox(void) {
+    static unsigned char slots[8 * 64];
+    mailbox_t box;
+    bench_clock_t start;
+    unsigned long calls, i;
+    unsigned int size, j;
+    for (size = 4; size <= 64; size *= 4) {
+        bench_setup();
+        mailbox_init(&box, slots, size, 8, INVALID_MODULE_HANDLE, &bench_mailbox_callback, EVENT_PRIORITY_LOW);
+        calls = bench_calls(size);
+        bench_start(&start);
+        for (i = 0; i < calls; ++i) {
+            for (j = 0; j < 8; ++j) {
+                mailbox_post(&box, bench_source, size);
+            }
+            event_manager(EVENT_PRIORITY_LOW);
+        }
+        bench_print("mailbox_post", "bytes", size, calls * 8, &start);
+        if (mailbox_lost(&box) != 0) {
+            fprintf(stderr, "kernel_bench: mailbox posts lost\n");
+            bench_valid = false;
+        }
+    }
+    if (!bench_mailbox_wrap()) {
+        fprintf(stderr, "kernel_bench: mailbox messages out of order\n");
+        bench_valid = false;
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* mode = "all";
+    if (argc > 1) {
+        mode = argv[1];
+    }
+    if (argc > 2) {
+        bench_work = strtoul(argv[2], NULL, 10);
+    }
+    // Host time in ns, cycles from the time stamp counter of the host
+    printf("# %-18s %-10s %6s %6s %6s %10s %10s %10s\n", "function", "param", "size",
+            "events", "tasks", "calls", "ns/call", "cyc/call");
+    if (strcmp(mode, "tables") == 0 || strcmp(mode, "all") == 0) {
+        bench_events();
+        bench_tasks();
+    }
+    if (strcmp(mode, "io") == 0 || strcmp(mode, "all") == 0) {
+        bench_data();
+        bench_modules();
+        bench_topics();
+        bench_mailbox();
+        bench_gpio();
+        bench_led();
+    }
+    return bench_valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
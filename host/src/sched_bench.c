@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+ */
+
+/******************************************************************************/
+/* Files to Include                                                           */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim/sched_sim.h"
+#include "system/trace.h"
+#include "system/cpu_load.h"
+#include "system/idle.h"
+#include "system/critical.h"
+#include "system/snapshot.h"
+
+/// Default number of ticks of each scenario
+#define BENCH_TICKS 1000000
+/// Kernel tick of 1 kHz on a 40 MIPS CPU
+#define BENCH_FREQ_TIMER 1000
+#define BENCH_CYCLES_PER_TICK 40000
+/// Cost of the kernel, in cycles
+#define BENCH_TICK_COST 400
+#define BENCH_DISPATCH_COST 100
+
+/// Scenario: the CPU and a set of jobs
+typedef struct _bench_scenario {
+    const char* name;               ///< Name in the report
+    sched_sim_config_t config;      ///< Virtual CPU
+    sched_sim_job_t jobs[SCHED_SIM_MAX_JOBS]; ///< Jobs, up to the first without frequency
+} bench_scenario_t;
+
+/// CPU of the firmware: callbacks masked up to the timer
+#define BENCH_CPU(level) {BENCH_CYCLES_PER_TICK, BENCH_FREQ_TIMER, 6, (level), {2, 3, 4, 1}, \
+                            BENCH_TICK_COST, BENCH_DISPATCH_COST}
+/// Job with a start offset
+#define BENCH_JOB(name, frequency, priority, cost, phase) {(name), (frequency), (priority), (cost), (phase), 0}
+/// Job with a software level
+#define BENCH_JOB_LEVEL(name, frequency, level, cost, phase) {(name), (frequency), EVENT_PRIORITY_LOW, (cost), (phase), (level)}
+/// Job with a budget in [uS]
+#define BENCH_JOB_BUDGET(name, frequency, priority, cost, phase, budget, overrun, skip) \
+                            {(name), (frequency), (priority), (cost), (phase), 0, (budget), (overrun), (skip)}
+
+/******************************************************************************/
+/* Global Variable Declaration                                                */
+/******************************************************************************/
+
+/// Control loops of a motor board: the same load with different settings
+bench_scenario_t scenarios[] = {
+    {"baseline", BENCH_CPU(5), {
+        BENCH_JOB("pid", 1000, EVENT_PRIORITY_HIGH, 8000, 0),
+        BENCH_JOB("odometry", 100, EVENT_PRIORITY_MEDIUM, 30000, 0),
+        BENCH_JOB("imu", 200, EVENT_PRIORITY_MEDIUM, 12000, 0),
+        BENCH_JOB("led", 10, EVENT_PRIORITY_LOW, 2000, 0),
+        BENCH_JOB("telemetry", 50, EVENT_PRIORITY_VERY_LOW, 60000, 0),
+    }},
+    {"phased", BENCH_CPU(5), {
+        BENCH_JOB("pid", 1000, EVENT_PRIORITY_HIGH, 8000, 0),
+        BENCH_JOB("odometry", 100, EVENT_PRIORITY_MEDIUM, 30000, 3),
+        BENCH_JOB("imu", 200, EVENT_PRIORITY_MEDIUM, 12000, 1),
+        BENCH_JOB("led", 10, EVENT_PRIORITY_LOW, 2000, 7),
+        BENCH_JOB("telemetry", 50, EVENT_PRIORITY_VERY_LOW, 60000, 9),
+    }},
+    {"masked", BENCH_CPU(7), {
+        BENCH_JOB("pid", 1000, EVENT_PRIORITY_HIGH, 8000, 0),
+        BENCH_JOB("odometry", 100, EVENT_PRIORITY_MEDIUM, 30000, 3),
+        BENCH_JOB("imu", 200, EVENT_PRIORITY_MEDIUM, 12000, 1),
+        BENCH_JOB("led", 10, EVENT_PRIORITY_LOW, 2000, 7),
+        BENCH_JOB("telemetry", 50, EVENT_PRIORITY_VERY_LOW, 60000, 9),
+    }},
+    {"overload", BENCH_CPU(5), {
+        BENCH_JOB("pid", 1000, EVENT_PRIORITY_HIGH, 8000, 0),
+        BENCH_JOB("odometry", 100, EVENT_PRIORITY_MEDIUM, 30000, 3),
+        BENCH_JOB("imu", 500, EVENT_PRIORITY_MEDIUM, 45000, 1),
+        BENCH_JOB("led", 10, EVENT_PRIORITY_LOW, 2000, 7),
+        BENCH_JOB("telemetry", 50, EVENT_PRIORITY_VERY_LOW, 60000, 9),
+    }},
+    {"demote", BENCH_CPU(5), {
+        BENCH_JOB("pid", 1000, EVENT_PRIORITY_HIGH, 8000, 0),
+        BENCH_JOB("odometry", 100, EVENT_PRIORITY_MEDIUM, 30000, 3),
+        BENCH_JOB_BUDGET("imu", 500, EVENT_PRIORITY_MEDIUM, 45000, 1, 1000, EVENT_OVERRUN_DEMOTE, 0),
+        BENCH_JOB("led", 10, EVENT_PRIORITY_LOW, 2000, 7),
+        BENCH_JOB("telemetry", 50, EVENT_PRIORITY_VERY_LOW, 60000, 9),
+    }},
+    {"skip", BENCH_CPU(5), {
+        BENCH_JOB("pid", 1000, EVENT_PRIORITY_HIGH, 8000, 0),
+        BENCH_JOB("odometry", 100, EVENT_PRIORITY_MEDIUM, 30000, 3),
+        BENCH_JOB_BUDGET("imu", 500, EVENT_PRIORITY_MEDIUM, 45000, 1, 1000, EVENT_OVERRUN_SKIP, 1),
+        BENCH_JOB("led", 10, EVENT_PRIORITY_LOW, 2000, 7),
+        BENCH_JOB("telemetry", 50, EVENT_PRIORITY_VERY_LOW, 60000, 9),
+    }},
+    {"shared", BENCH_CPU(5), {
+        BENCH_JOB("telemetry", 50, EVENT_PRIORITY_MEDIUM, 60000, 9),
+        BENCH_JOB("led", 10, EVENT_PRIORITY_MEDIUM, 2000, 7),
+        BENCH_JOB("odometry", 100, EVENT_PRIORITY_MEDIUM, 30000, 3),
+        BENCH_JOB("imu", 200, EVENT_PRIORITY_MEDIUM, 12000, 1),
+        BENCH_JOB("pid", 1000, EVENT_PRIORITY_MEDIUM, 8000, 0),
+    }},
+    {"levels", BENCH_CPU(5), {
+        BENCH_JOB_LEVEL("telemetry", 50, 8, 60000, 9),
+        BENCH_JOB_LEVEL("led", 10, 8, 2000, 7),
+        BENCH_JOB_LEVEL("odometry", 100, 9, 30000, 3),
+        BENCH_JOB_LEVEL("imu", 200, 10, 12000, 1),
+        BENCH_JOB_LEVEL("pid", 1000, 11, 8000, 0),
+    }},
+};
+
+/*****************************************************************************/
+/* Communication Functions                                                   */
+/*****************************************************************************/
+
+static uint64_t bench_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+/**
+ * Save the trace of the kernel in <scenario>.trace, if the kernel records it
+ */
+static void bench_trace(const bench_scenario_t* scenario) {
+    const void* data;
+    size_t size;
+    char name[64];
+    FILE* file;
+    trace_enable(false);
+    size = trace_dump(&data);
+    if (size == 0) {
+        return;
+    }
+    snprintf(name, sizeof(name), "%s.trace", scenario->name);
+    file = fopen(name, "wb");
+    if (file == NULL || fwrite(data, 1, size, file) != size) {
+        fprintf(stderr, "sched_bench: can not write %s\n", name);
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+}
+/**
+ * Save the state of the kernel in <scenario>.snap
+ */
+static void bench_snapshot(const bench_scenario_t* scenario) {
+    static uint8_t data[4096];
+    char name[64];
+    FILE* file;
+    size_t size = snapshot_take(data, sizeof(data));
+    if (size == 0) {
+        fprintf(stderr, "sched_bench: %s: snapshot too large\n", scenario->name);
+        return;
+    }
+    snprintf(name, sizeof(name), "%s.snap", scenario->name);
+    file = fopen(name, "wb");
+    if (file == NULL || fwrite(data, 1, size, file) != size) {
+        fprintf(stderr, "sched_bench: can not write %s\n", name);
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+}
+/**
+ * Run a scenario and print a row for the CPU, a row for each job and a row
+ * for each critical section
+ * @return false if the kernel refuses a job
+ */
+static bool bench_run(bench_scenario_t* scenario, uint64_t ticks, bool snapshot) {
+    sched_sim_stats_t stats;
+    uint16_t load[LNG_CPU_LOAD];
+    idle_stats_t idle;
+    sched_sim_job_t* job;
+    critical_site_t* site;
+    uint64_t start, ns;
+    unsigned short i, count;
+    sched_sim_init(&scenario->config);
+    for (count = 0; count < SCHED_SIM_MAX_JOBS && scenario->jobs[count].frequency != 0; ++count) {
+        if (!sched_sim_add(&scenario->jobs[count])) {
+            fprintf(stderr, "sched_bench: %s: job %s refused\n", scenario->name, scenario->jobs[count].name);
+            return false;
+        }
+    }
+    start = bench_now();
+    sched_sim_run(ticks);
+    ns = bench_now() - start;
+    bench_trace(scenario);
+    if (snapshot) {
+        bench_snapshot(scenario);
+    }
+    sched_sim_get_stats(&stats);
+    // Load from the kernel, in the last 10 s
+    cpu_load_get(CPU_LOAD_10S, load);
+    idle_get_stats(&idle);
+    printf("%-10s %-10s %10llu %10llu %8llu %8.2f %8.2f %8.2f %8.1f %8.2f %8.1f %8u\n", scenario->name, "cpu",
+            (unsigned long long) stats.ticks, (unsigned long long) stats.lost_ticks,
+            (unsigned long long) stats.dispatches,
+            100.0 * (stats.cycles - stats.idle) / stats.cycles,
+            (CPU_LOAD_FULL - load[CPU_LOAD_IDLE]) / 100.0,
+            100.0 * (idle.residency + (double) idle.residency_counts / BENCH_CYCLES_PER_TICK) / stats.ticks,
+            (double) ns / stats.ticks,
+            1e3 * stats.ticks / ns,
+            (double) stats.tick_delay_total / stats.ticks, stats.tick_delay_max);
+    for (i = 0; i < count; ++i) {
+        job = &scenario->jobs[i];
+        printf("%-10s %-10s %10u %10u %8u %8u %8.1f %8u %8.1f %8u\n", scenario->name, job->name,
+                job->stats.releases, job->stats.runs, job->stats.dropped, job->stats.overruns,
+                job->stats.runs ? (double) job->stats.latency_total / job->stats.runs : 0.0,
+                job->stats.runs ? job->stats.latency_max : 0,
+                job->stats.runs > 1 ? (double) job->stats.jitter_total / (job->stats.runs - 1) : 0.0,
+                job->stats.jitter_max);
+    }
+    for (site = critical_sites(); site != NULL; site = site->next) {
+        if (site->count > 0) {
+            printf("%-10s %-10s %10u %10u %s:%u\n", scenario->name, "critical",
+                    site->count, site->max, site->name, site->line);
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    uint64_t ticks = BENCH_TICKS;
+    bool valid = true;
+    bool snapshot = false;
+    unsigned short i;
+    if (argc > 1) {
+        ticks = strtoull(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        snapshot = (strcmp(argv[2], "snapshot") == 0);
+    }
+    // Cycles in virtual time, ns in host time
+    printf("# %-8s %-10s %10s %10s %8s %8s %8s %8s %8s %8s %8s %8s\n", "scenario", "cpu", "ticks", "lost",
+            "irqs", "load%", "kload%", "idle%", "ns/tick", "Mtick/s", "tdel_avg", "tdel_max");
+    printf("# %-8s %-10s %10s %10s %8s %8s %8s %8s %8s %8s\n", "scenario", "job", "releases", "runs",
+            "dropped", "overrun", "lat_avg", "lat_max", "jit_avg", "jit_max");
+    printf("# %-8s %-10s %10s %10s %s\n", "scenario", "critical", "count", "max", "site");
+    for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i) {
+        valid &= bench_run(&scenarios[i], ticks, snapshot);
+    }
+    return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+ */
+
+/******************************************************************************/
+/* Files to Include                                                           */
+/******************************************************************************/
+
+#include <string.h>
+
+#include "sim/i2c_devices.h"
+
+/// Status bits of the slave controller
+#define MASK_I2CSTAT_ACKSTAT     BIT_MASK(15)
+#define MASK_I2CSTAT_D_A         BIT_MASK(5)
+#define MASK_I2CSTAT_R_W         BIT_MASK(2)
+
+/*****************************************************************************/
+/* EEPROM                                                                    */
+/*****************************************************************************/
+
+static bool i2c_eeprom_start(i2c_sim_device_t* device, bool read) {
+    i2c_eeprom_t* eeprom = (i2c_eeprom_t*) device;
+    if (!read) {
+        eeprom->phase = 0;
+    }
+    return true;
+}
+
+static bool i2c_eeprom_write(i2c_sim_device_t* device, unsigned char data) {
+    i2c_eeprom_t* eeprom = (i2c_eeprom_t*) device;
+    uint16_t page;
+    switch (eeprom->phase) {
+        case 0:
+            eeprom->pointer = (uint16_t) data << 8;
+            eeprom->phase++;
+            break;
+        case 1:
+            eeprom->pointer = (eeprom->pointer | data) % eeprom->size;
+            eeprom->phase++;
+            break;
+        default:
+            eeprom->memory[eeprom->pointer] = data;
+            eeprom->writes++;
+            // The write wraps in the page
+            page = eeprom->pointer & ~(I2C_EEPROM_PAGE - 1);
+            eeprom->pointer = page | ((eeprom->pointer + 1) & (I2C_EEPROM_PAGE - 1));
+            break;
+    }
+    return true;
+}
+
+static unsigned char i2c_eeprom_read(i2c_sim_device_t* device) {
+    i2c_eeprom_t* eeprom = (i2c_eeprom_t*) device;
+    unsigned char data = eeprom->memory[eeprom->pointer];
+    eeprom->pointer = (eeprom->pointer + 1) % eeprom->size;
+    return data;
+}
+
+i2c_sim_device_t* i2c_eeprom_init(i2c_eeprom_t* eeprom, unsigned char address, uint16_t size) {
+    memset(eeprom, 0, sizeof(i2c_eeprom_t));
+    memset(eeprom->memory, 0xFF, sizeof(eeprom->memory));
+    eeprom->size = (size > I2C_EEPROM_MAX_SIZE || size == 0) ? I2C_EEPROM_MAX_SIZE : size;
+    eeprom->device.address = address;
+    eeprom->device.start = &i2c_eeprom_start;
+    eeprom->device.write = &i2c_eeprom_write;
+    eeprom->device.read = &i2c_eeprom_read;
+    eeprom->device.stop = NULL;
+    eeprom->device.ack = NULL;
+    return &eeprom->device;
+}
+
+/*****************************************************************************/
+/* Register map                                                              */
+/*****************************************************************************/
+
+static bool i2c_regmap_start(i2c_sim_device_t* device, bool read) {
+    i2c_regmap_t* regmap = (i2c_regmap_t*) device;
+    if (read) {
+        if (regmap->update != NULL) {
+            regmap->update(regmap);
+        }
+    } else {
+        regmap->pointer_set = false;
+    }
+    return true;
+}
+
+static bool i2c_regmap_write(i2c_sim_device_t* device, unsigned char data) {
+    i2c_regmap_t* regmap = (i2c_regmap_t*) device;
+    if (!regmap->pointer_set) {
+        regmap->pointer = data;
+        regmap->pointer_set = true;
+    } else {
+        regmap->regs[regmap->pointer++] = data;
+    }
+    return true;
+}
+
+static unsigned char i2c_regmap_read(i2c_sim_device_t* device) {
+    i2c_regmap_t* regmap = (i2c_regmap_t*) device;
+    return regmap->regs[regmap->pointer++];
+}
+
+i2c_sim_device_t* i2c_regmap_init(i2c_regmap_t* regmap, unsigned char address, i2c_regmap_update_t update) {
+    memset(regmap, 0, sizeof(i2c_regmap_t));
+    regmap->update = update;
+    regmap->device.address = address;
+    regmap->device.start = &i2c_regmap_start;
+    regmap->device.write = &i2c_regmap_write;
+    regmap->device.read = &i2c_regmap_read;
+    regmap->device.stop = NULL;
+    regmap->device.ack = NULL;
+    return &regmap->device;
+}
+
+/*****************************************************************************/
+/* IMU                                                                       */
+/*****************************************************************************/
+/**
+ * New sample when the read starts in the sample registers. Every value
+ * is a ramp from the number of the sample, big endian.
+ */
+static void i2c_imu_update(i2c_regmap_t* imu) {
+    unsigned char i;
+    uint16_t value;
+    if (imu->pointer < I2C_IMU_ACCEL_XOUT_H
+            || imu->pointer >= I2C_IMU_ACCEL_XOUT_H + I2C_IMU_SAMPLE_SIZE) {
+        return;
+    }
+    imu->samples++;
+    for (i = 0; i < I2C_IMU_SAMPLE_SIZE / 2; ++i) {
+        value = (uint16_t) (imu->samples + i * 1000);
+        imu->regs[I2C_IMU_ACCEL_XOUT_H + 2 * i] = value >> 8;
+        imu->regs[I2C_IMU_ACCEL_XOUT_H + 2 * i + 1] = value & 0xFF;
+    }
+}
+
+i2c_sim_device_t* i2c_imu_init(i2c_regmap_t* imu, unsigned char address) {
+    i2c_sim_device_t* device = i2c_regmap_init(imu, address, &i2c_imu_update);
+    imu->regs[I2C_IMU_WHO_AM_I] = I2C_IMU_ADDRESS;
+    imu->regs[I2C_IMU_PWR_MGMT_1] = 0x40;
+    return device;
+}
+
+/*****************************************************************************/
+/* Slave port                                                                */
+/*****************************************************************************/
+/**
+ * A byte for the slave: the status of the byte and the interrupt
+ * @param port the port
+ * @param status D_A and R_W of the byte
+ * @param data byte received
+ */
+static void i2c_slave_port_receive(i2c_slave_port_t* port, unsigned int status, unsigned char data) {
+    port->STAT = (port->STAT & ~(MASK_I2CSTAT_D_A | MASK_I2CSTAT_R_W)) | status;
+    port->RCV = data;
+    I2C_slave_manager(port->slave);
+}
+
+static bool i2c_slave_port_start(i2c_sim_device_t* device, bool read) {
+    i2c_slave_port_t* port = (i2c_slave_port_t*) device;
+    unsigned char address = (unsigned char) (port->ADD << 1) | (read ? 1 : 0);
+    i2c_slave_port_receive(port, read ? MASK_I2CSTAT_R_W : 0, address);
+    return true;
+}
+
+static bool i2c_slave_port_write(i2c_sim_device_t* device, unsigned char data) {
+    i2c_slave_port_t* port = (i2c_slave_port_t*) device;
+    i2c_slave_port_receive(port, MASK_I2CSTAT_D_A, data);
+    return true;
+}
+
+static unsigned char i2c_slave_port_read(i2c_sim_device_t* device) {
+    i2c_slave_port_t* port = (i2c_slave_port_t*) device;
+    return port->TRN & 0xFF;
+}
+
+static void i2c_slave_port_ack(i2c_sim_device_t* device, bool ack) {
+    i2c_slave_port_t* port = (i2c_slave_port_t*) device;
+    if (ack) {
+        port->STAT &= ~MASK_I2CSTAT_ACKSTAT;
+    } else {
+        port->STAT |= MASK_I2CSTAT_ACKSTAT;
+    }
+    port->STAT |= MASK_I2CSTAT_D_A | MASK_I2CSTAT_R_W;
+    I2C_slave_manager(port->slave);
+}
+
+i2c_sim_device_t* i2c_slave_port_init(i2c_slave_port_t* port, i2c_slave_t* slave, unsigned char address) {
+    memset(port, 0, sizeof(i2c_slave_port_t));
+    port->slave = slave;
+    port->interrupt.REG = &port->IFS;
+    port->interrupt.CS_mask = BIT_MASK(0);
+    I2C_slave_Init(slave, &port->interrupt, &port->CON, &port->STAT, &port->ADD, &port->TRN, &port->RCV, address);
+    port->device.address = address;
+    port->device.start = &i2c_slave_port_start;
+    port->device.write = &i2c_slave_port_write;
+    port->device.read = &i2c_slave_port_read;
+    port->device.stop = NULL;
+    port->device.ack = &i2c_slave_port_ack;
+    return &port->device;
+}
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+ */
+
+/******************************************************************************/
+/* Files to Include                                                           */
+/******************************************************************************/
+
+#include <string.h>
+
+#include "sim/i2c_sim.h"
+
+/// Bits of the controller, as in the dsPIC33F family reference manual
+#define MASK_I2CCON_EN           BIT_MASK(15)
+#define MASK_I2CCON_ACKDT        BIT_MASK(5)
+#define MASK_I2CCON_ACKEN        BIT_MASK(4)
+#define MASK_I2CCON_RCEN         BIT_MASK(3)
+#define MASK_I2CCON_PEN          BIT_MASK(2)
+#define MASK_I2CCON_RSEN         BIT_MASK(1)
+#define MASK_I2CCON_SEN          BIT_MASK(0)
+
+#define MASK_I2CSTAT_ACKSTAT     BIT_MASK(15)
+#define MASK_I2CSTAT_BCL         BIT_MASK(10)
+#define MASK_I2CSTAT_P           BIT_MASK(4)
+#define MASK_I2CSTAT_S           BIT_MASK(3)
+#define MASK_I2CSTAT_RBF         BIT_MASK(1)
+
+/// Operations requested in CON
+#define MASK_I2CCON_OPERATIONS   (MASK_I2CCON_SEN | MASK_I2CCON_RSEN | MASK_I2CCON_PEN \
+                                  | MASK_I2CCON_RCEN | MASK_I2CCON_ACKEN)
+
+/// SCL periods of each operation
+#define I2C_SIM_BITS_START 1
+#define I2C_SIM_BITS_STOP  1
+#define I2C_SIM_BITS_BYTE  9
+#define I2C_SIM_BITS_ACK   1
+#define I2C_SIM_BITS_READ  8
+
+/******************************************************************************/
+/* Global Variable Declaration                                                */
+/******************************************************************************/
+
+/// Tick of the kernel, moved with the bus time
+extern volatile uint32_t task_ticks;
+
+/*****************************************************************************/
+/* Communication Functions                                                   */
+/*****************************************************************************/
+
+void i2c_sim_init(i2c_sim_t* sim, unsigned int bits_per_tick) {
+    memset(sim, 0, sizeof(i2c_sim_t));
+    sim->TRN = I2C_SIM_TRN_EMPTY;
+    sim->interrupt.REG = &sim->IFS;
+    sim->interrupt.CS_mask = BIT_MASK(1);
+    sim->bits_per_tick = bits_per_tick;
+    sim->bits_left = bits_per_tick;
+    // Released pins, pulled up
+    sim->PINS_TRIS = I2C_SIM_PIN_SCL | I2C_SIM_PIN_SDA;
+    sim->PINS_PORT = I2C_SIM_PIN_SCL | I2C_SIM_PIN_SDA;
+    sim->scl.CS_TRIS = &sim->PINS_TRIS;
+    sim->scl.CS_PORT = &sim->PINS_PORT;
+    sim->scl.CS_LAT = &sim->PINS_LAT;
+    sim->scl.CS_mask = I2C_SIM_PIN_SCL;
+    sim->scl.type = GPIO_OUTPUT;
+    sim->sda = sim->scl;
+    sim->sda.CS_mask = I2C_SIM_PIN_SDA;
+}
+
+void i2c_sim_fault(i2c_sim_t* sim, i2c_sim_fault_t fault) {
+    sim->fault = fault;
+    if (fault == I2C_SIM_FAULT_STUCK) {
+        sim->PINS_TRIS &= ~I2C_SIM_PIN_SCL;
+        sim->PINS_PORT &= ~I2C_SIM_PIN_SDA;
+    }
+}
+
+void i2c_sim_timer(i2c_sim_t* sim, REGISTER timer_register, REGISTER pr_timer) {
+    sim->timer = timer_register;
+    sim->pr_timer = pr_timer;
+}
+
+bool i2c_sim_attach(i2c_sim_t* sim, i2c_sim_device_t* device) {
+    if (sim->devices_len >= I2C_SIM_MAX_DEVICES) {
+        return false;
+    }
+    sim->devices[sim->devices_len++] = device;
+    return true;
+}
+
+hEvent_t i2c_sim_bus(i2c_sim_t* sim, i2c_bus_t* bus, I2C_resetFunc resetCallback) {
+    return I2C_Init(bus, &sim->interrupt, &sim->CON, &sim->STAT, &sim->TRN, &sim->RCV, resetCallback);
+}
+/**
+ * Add the time of an operation and move the kernel tick
+ * @param sim the simulated controller
+ * @param bits SCL periods of the operation
+ */
+static void i2c_sim_clock(i2c_sim_t* sim, unsigned int bits) {
+    sim->stats.bits += bits;
+    if (sim->bits_per_tick == 0) {
+        return;
+    }
+    while (bits >= sim->bits_left) {
+        bits -= sim->bits_left;
+        sim->bits_left = sim->bits_per_tick;
+        task_ticks++;
+    }
+    sim->bits_left -= bits;
+    if (sim->timer != NULL) {
+        *sim->timer = ((uint32_t) (sim->bits_per_tick - sim->bits_left) * ((*sim->pr_timer) + 1))
+                / sim->bits_per_tick;
+    }
+}
+/**
+ * Check a start against the faults
+ * @param sim the simulated controller
+ * @return false if the start collides
+ */
+static bool i2c_sim_arbitrate(i2c_sim_t* sim) {
+    if (sim->fault == I2C_SIM_FAULT_STUCK) {
+        if ((sim->PINS_TRIS & I2C_SIM_PIN_SCL) == 0) {
+            return false;
+        }
+        // Clocked from the recovery, the device releases SDA
+        sim->PINS_PORT |= I2C_SIM_PIN_SDA;
+        sim->fault = I2C_SIM_FAULT_NONE;
+    } else if (sim->fault == I2C_SIM_FAULT_COLLISION) {
+        sim->fault = I2C_SIM_FAULT_NONE;
+        return false;
+    }
+    return true;
+}
+/**
+ * Start condition, the next byte is an address
+ */
+static void i2c_sim_start(i2c_sim_t* sim) {
+    sim->STAT = (sim->STAT & ~MASK_I2CSTAT_P) | MASK_I2CSTAT_S;
+    sim->selected = NULL;
+    sim->address = true;
+    i2c_sim_clock(sim, I2C_SIM_BITS_START);
+}
+/**
+ * Stop condition, release the device
+ */
+static void i2c_sim_stop(i2c_sim_t* sim) {
+    if (sim->selected != NULL && sim->selected->stop != NULL) {
+        sim->selected->stop(sim->selected);
+    }
+    sim->selected = NULL;
+    sim->address = false;
+    sim->STAT = (sim->STAT & ~MASK_I2CSTAT_S) | MASK_I2CSTAT_P;
+    sim->stats.stops++;
+    i2c_sim_clock(sim, I2C_SIM_BITS_STOP);
+}
+/**
+ * Send the byte in TRN to the devices
+ * @param data byte to send
+ * @return ACK of the device
+ */
+static bool i2c_sim_transmit(i2c_sim_t* sim, unsigned char data) {
+    unsigned char i;
+    sim->stats.bytes_tx++;
+    i2c_sim_clock(sim, I2C_SIM_BITS_BYTE);
+    if (sim->address) {
+        sim->address = false;
+        for (i = 0; i < sim->devices_len; ++i) {
+            if (sim->devices[i]->address == (data >> 1)) {
+                if (sim->devices[i]->start(sim->devices[i], data & 0x01)) {
+                    sim->selected = sim->devices[i];
+                    return true;
+                }
+                return false;
+            }
+        }
+        return false;
+    }
+    if (sim->selected == NULL) {
+        return false;
+    }
+    return sim->selected->write(sim->selected, data);
+}
+
+bool i2c_sim_step(i2c_sim_t* sim) {
+    if ((sim->CON & MASK_I2CCON_EN) == 0) {
+        // Controller off
+        return false;
+    } else if (sim->fault == I2C_SIM_FAULT_HANG
+            && ((sim->CON & MASK_I2CCON_OPERATIONS) || sim->TRN != I2C_SIM_TRN_EMPTY)) {
+        // The operation never ends, only a reset of the controller restarts the bus
+        sim->CON &= ~MASK_I2CCON_OPERATIONS;
+        sim->TRN = I2C_SIM_TRN_EMPTY;
+        sim->fault = I2C_SIM_FAULT_NONE;
+        sim->stats.hangs++;
+        return false;
+    } else if ((sim->CON & (MASK_I2CCON_SEN | MASK_I2CCON_RSEN)) && !i2c_sim_arbitrate(sim)) {
+        // The controller drops the start and goes back in idle
+        sim->CON &= ~(MASK_I2CCON_SEN | MASK_I2CCON_RSEN);
+        sim->STAT |= MASK_I2CSTAT_BCL;
+        sim->selected = NULL;
+        sim->address = false;
+        sim->stats.collisions++;
+    } else if (sim->CON & MASK_I2CCON_SEN) {
+        sim->CON &= ~MASK_I2CCON_SEN;
+        sim->stats.starts++;
+        i2c_sim_start(sim);
+    } else if (sim->CON & MASK_I2CCON_RSEN) {
+        sim->CON &= ~MASK_I2CCON_RSEN;
+        sim->stats.restarts++;
+        i2c_sim_start(sim);
+    } else if (sim->CON & MASK_I2CCON_PEN) {
+        sim->CON &= ~MASK_I2CCON_PEN;
+        i2c_sim_stop(sim);
+    } else if (sim->CON & MASK_I2CCON_RCEN) {
+        sim->CON &= ~MASK_I2CCON_RCEN;
+        sim->RCV = (sim->selected != NULL) ? sim->selected->read(sim->selected) : 0xFF;
+        sim->STAT |= MASK_I2CSTAT_RBF;
+        sim->stats.bytes_rx++;
+        i2c_sim_clock(sim, I2C_SIM_BITS_READ);
+    } else if (sim->CON & MASK_I2CCON_ACKEN) {
+        sim->CON &= ~MASK_I2CCON_ACKEN;
+        sim->STAT &= ~MASK_I2CSTAT_RBF;
+        i2c_sim_clock(sim, I2C_SIM_BITS_ACK);
+        if (sim->selected != NULL && sim->selected->ack != NULL) {
+            sim->selected->ack(sim->selected, (sim->CON & MASK_I2CCON_ACKDT) == 0);
+        }
+    } else if (sim->TRN != I2C_SIM_TRN_EMPTY) {
+        unsigned char data = sim->TRN & 0xFF;
+        sim->TRN = I2C_SIM_TRN_EMPTY;
+        if (i2c_sim_transmit(sim, data)) {
+            sim->STAT &= ~MASK_I2CSTAT_ACKSTAT;
+        } else {
+            sim->STAT |= MASK_I2CSTAT_ACKSTAT;
+            sim->stats.nacks++;
+        }
+    } else {
+        // Nothing requested, no interrupt
+        return false;
+    }
+    REGISTER_MASK_SET_HIGH(sim->interrupt.REG, sim->interrupt.CS_mask);
+    return true;
+}
+
+uint32_t i2c_sim_run(i2c_sim_t* sim, i2c_bus_t* bus) {
+    uint32_t count = 0;
+    while (REGISTER_MASK_READ(sim->interrupt.REG, sim->interrupt.CS_mask)) {
+        // The interrupt routine clears the flag and runs the manager
+        REGISTER_MASK_SET_LOW(sim->interrupt.REG, sim->interrupt.CS_mask);
+        I2C_manager(bus);
+        count++;
+        i2c_sim_step(sim);
+    }
+    sim->stats.interrupts += count;
+    return count;
+}
@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+ */
+
+/******************************************************************************/
+/* Files to Include                                                           */
+/******************************************************************************/
+
+#include <string.h>
+
+#include "hal/hal.h"
+#include "sim/sched_sim.h"
+#include "system/trace.h"
+#include "system/cpu_load.h"
+#include "system/idle.h"
+#include "system/critical.h"
+
+/// Bit of the timer in the flag register, the events follow
+#define SCHED_SIM_TIMER_BIT 0
+
+/******************************************************************************/
+/* Global Variable Declaration                                                */
+/******************************************************************************/
+
+/// Registers of the virtual CPU: timer, period and interrupt flags
+volatile unsigned int sched_sim_TMR, sched_sim_PR, sched_sim_IFS;
+hardware_bit_t sched_sim_timer_flag = REGISTER_INIT(sched_sim_IFS, SCHED_SIM_TIMER_BIT);
+hardware_bit_t sched_sim_event_flag[LNG_EVENTPRIORITY] = {
+    REGISTER_INIT(sched_sim_IFS, SCHED_SIM_TIMER_BIT + 1),
+    REGISTER_INIT(sched_sim_IFS, SCHED_SIM_TIMER_BIT + 2),
+    REGISTER_INIT(sched_sim_IFS, SCHED_SIM_TIMER_BIT + 3),
+    REGISTER_INIT(sched_sim_IFS, SCHED_SIM_TIMER_BIT + 4),
+};
+
+sched_sim_config_t sched_sim_config;
+sched_sim_stats_t sched_sim_stats;
+/// Virtual time and time of the next timer interrupt
+uint64_t sched_sim_time, sched_sim_next_tick, sched_sim_last_tick;
+/// Jobs registered
+sched_sim_job_t* sched_sim_jobs[SCHED_SIM_MAX_JOBS];
+unsigned short sched_sim_job_counter = 0;
+
+/*****************************************************************************/
+/* Communication Functions                                                   */
+/*****************************************************************************/
+
+/**
+ * Move the timer register with the virtual time, the period of the timer
+ * is a tick
+ */
+static inline void sched_sim_timer_update(void) {
+    sched_sim_TMR = (unsigned int) (sched_sim_time - sched_sim_last_tick);
+}
+/**
+ * Releases of the jobs, with the rule of task_manager: a task runs every
+ * FREQ_TIMER / frequency ticks, one period after the start
+ */
+static void sched_sim_release(void) {
+    unsigned short i;
+    sched_sim_job_t* job;
+    for (i = 0; i < sched_sim_job_counter; ++i) {
+        job = sched_sim_jobs[i];
+        if (!job->started) {
+            if (sched_sim_stats.ticks <= job->phase) {
+                continue;
+            }
+            task_set(job->task, RUN);
+            job->started = true;
+        }
+        if (job->counter >= job->period) {
+            job->stats.releases++;
+            if (job->running) {
+                // event_manager clears the pending flag at the end of the callback
+                job->stats.overruns++;
+            } else if (job->backlog_len < SCHED_SIM_MAX_BACKLOG) {
+                job->backlog[job->backlog_len++] = sched_sim_time;
+            } else {
+                job->stats.dropped++;
+            }
+            job->counter = 0;
+        }
+        job->counter++;
+    }
+}
+/**
+ * Timer interrupt: the kernel tick
+ */
+static void sched_sim_timer_isr(void) {
+    uint32_t delay = (uint32_t) (sched_sim_time - sched_sim_last_tick);
+    sched_sim_stats.ticks++;
+    sched_sim_stats.tick_delay_total += delay;
+    if (delay > sched_sim_stats.tick_delay_max) {
+        sched_sim_stats.tick_delay_max = delay;
+    }
+    sched_sim_release();
+    task_manager();
+    sched_sim_consume(sched_sim_config.tick_cost);
+}
+
+static inline void sched_sim_event_isr(eventPriority priority) {
+    sched_sim_stats.dispatches++;
+    sched_sim_consume(sched_sim_config.dispatch_cost);
+    event_manager(priority);
+}
+
+static void sched_sim_low_isr(void) {
+    sched_sim_event_isr(EVENT_PRIORITY_LOW);
+}
+
+static void sched_sim_medium_isr(void) {
+    sched_sim_event_isr(EVENT_PRIORITY_MEDIUM);
+}
+
+static void sched_sim_high_isr(void) {
+    sched_sim_event_isr(EVENT_PRIORITY_HIGH);
+}
+
+static void sched_sim_very_low_isr(void) {
+    sched_sim_event_isr(EVENT_PRIORITY_VERY_LOW);
+}
+/**
+ * Edge of the timer: set the flag and take the interrupts over the CPU
+ */
+static void sched_sim_tick(void) {
+    if (REGISTER_MASK_READ(sched_sim_timer_flag.REG, sched_sim_timer_flag.CS_mask)) {
+        sched_sim_stats.lost_ticks++;
+    }
+    REGISTER_MASK_SET_HIGH(sched_sim_timer_flag.REG, sched_sim_timer_flag.CS_mask);
+    sched_sim_last_tick = sched_sim_next_tick;
+    sched_sim_next_tick += sched_sim_config.cycles_per_tick;
+    sched_sim_timer_update();
+    hal_interrupt_dispatch();
+}
+/**
+ * Power save of the CPU: nothing runs up to the next tick. The timer runs
+ * also in sleep, the kernel sleeps only without running tasks.
+ * @param mode idle or sleep
+ */
+static void sched_sim_power(unsigned int mode) {
+    sched_sim_stats.idle += sched_sim_next_tick - sched_sim_time;
+    sched_sim_time = sched_sim_next_tick;
+    sched_sim_tick();
+}
+/**
+ * Synthetic callback of a job, argv[0] is the job
+ */
+static void sched_sim_callback(int argc, event_arg_t* argv) {
+    sched_sim_job_t* job = (sched_sim_job_t*) argv[0];
+    uint64_t start = sched_sim_time;
+    uint32_t latency, deviation, period;
+    if (job->backlog_len > 0) {
+        latency = (uint32_t) (start - job->backlog[0]);
+        job->stats.latency_total += latency;
+        if (latency < job->stats.latency_min) {
+            job->stats.latency_min = latency;
+        }
+        if (latency > job->stats.latency_max) {
+            job->stats.latency_max = latency;
+        }
+        job->stats.dropped += job->backlog_len - 1;
+        job->backlog_len = 0;
+    }
+    if (job->last_start > 0) {
+        period = job->period * sched_sim_config.cycles_per_tick;
+        deviation = (uint32_t) (start - job->last_start);
+        deviation = deviation > period ? deviation - period : period - deviation;
+        job->stats.jitter_total += deviation;
+        if (deviation > job->stats.jitter_max) {
+            job->stats.jitter_max = deviation;
+        }
+    }
+    job->last_start = start;
+    job->stats.runs++;
+    job->running = true;
+    sched_sim_consume(job->cost);
+    job->running = false;
+}
+
+void sched_sim_init(const sched_sim_config_t* config) {
+    static const hal_isr_t isr[LNG_EVENTPRIORITY] = {
+        &sched_sim_low_isr, &sched_sim_medium_isr, &sched_sim_high_isr, &sched_sim_very_low_isr
+    };
+    unsigned short i;
+    sched_sim_config = *config;
+    memset(&sched_sim_stats, 0, sizeof(sched_sim_stats));
+    sched_sim_job_counter = 0;
+    // The time starts at the first tick
+    sched_sim_time = 0;
+    sched_sim_last_tick = 0;
+    sched_sim_next_tick = 0;
+    sched_sim_IFS = 0;
+    sched_sim_PR = config->cycles_per_tick - 1;
+    sched_sim_timer_update();
+
+    hal_init();
+    init_modules();
+    hal_power_register(&sched_sim_power);
+    hal_interrupt_register(&sched_sim_timer_flag, config->timer_ipl, &sched_sim_timer_isr);
+    init_events(&sched_sim_TMR, &sched_sim_PR, (frequency_t) config->cycles_per_tick * config->frequency, config->level);
+    for (i = 0; i < LNG_EVENTPRIORITY; ++i) {
+        register_interrupt(i, &sched_sim_event_flag[i]);
+        hal_interrupt_register(&sched_sim_event_flag[i], config->event_ipl[i], isr[i]);
+    }
+    task_init(config->frequency);
+    trace_init(&sched_sim_TMR, &sched_sim_PR, config->frequency);
+    cpu_load_init(&sched_sim_TMR, &sched_sim_PR, config->frequency);
+    idle_init(&sched_sim_TMR, &sched_sim_PR, false);
+    critical_init(&sched_sim_TMR, &sched_sim_PR);
+}
+
+bool sched_sim_add(sched_sim_job_t* job) {
+    hModule_t module;
+    if (sched_sim_job_counter >= SCHED_SIM_MAX_JOBS || job->frequency == 0
+            || job->frequency > sched_sim_config.frequency) {
+        return false;
+    }
+    job->module.string = job->name;
+    job->module.len = strlen(job->name) + 1;
+    module = register_module(&job->module);
+    if (job->level != 0) {
+        job->event = register_event_level(module, &sched_sim_callback, job->level);
+    } else {
+        job->event = register_event_p(module, &sched_sim_callback, job->priority);
+    }
+    if (job->event == INVALID_EVENT_HANDLE) {
+        return false;
+    }
+    if (job->budget != EVENT_NO_BUDGET) {
+        event_set_budget(job->event, job->budget, job->overrun, job->skip);
+    }
+    job->task = task_load_data(job->event, job->frequency, 1, (event_arg_t) job);
+    if (job->task == INVALID_TASK_HANDLE) {
+        return false;
+    }
+    job->period = sched_sim_config.frequency / job->frequency;
+    job->counter = 0;
+    job->started = false;
+    job->running = false;
+    job->backlog_len = 0;
+    job->last_start = 0;
+    memset(&job->stats, 0, sizeof(job->stats));
+    job->stats.latency_min = UINT32_MAX;
+    sched_sim_jobs[sched_sim_job_counter++] = job;
+    return true;
+}
+
+void sched_sim_consume(uint32_t cycles) {
+    uint64_t step;
+    while (cycles > 0) {
+        step = sched_sim_next_tick - sched_sim_time;
+        if (step > cycles) {
+            step = cycles;
+        }
+        sched_sim_time += step;
+        cycles -= (uint32_t) step;
+        sched_sim_timer_update();
+        if (sched_sim_time == sched_sim_next_tick) {
+            sched_sim_tick();
+        }
+    }
+}
+
+void sched_sim_run(uint64_t ticks) {
+    uint64_t end = sched_sim_next_tick + ticks * sched_sim_config.cycles_per_tick;
+    // The main loop of the firmware
+    while (sched_sim_next_tick < end) {
+        if (!idle_manager()) {
+            sched_sim_power(HAL_POWER_IDLE);
+        }
+    }
+}
+
+uint64_t sched_sim_now(void) {
+    return sched_sim_time;
+}
+
+void sched_sim_get_stats(sched_sim_stats_t* stats) {
+    *stats = sched_sim_stats;
+    stats->cycles = sched_sim_time;
+}
@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+ */
+/*
+ * Decoder of a kernel snapshot (system/snapshot.h) to text, a table for
+ * each section. Unknown sections are skipped from their header.
+ *
+ *     snapshot_decode state.snap
+ */
+
+/******************************************************************************/
+/* Files to Include                                                           */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "system/snapshot.h"
+#include "decode/decode.h"
+
+/// Index of a record padded from the kernel, snapshot_pad
+#define DECODE_PADDING 0xFFFF
+
+/******************************************************************************/
+/* Global Variable Declaration                                                */
+/******************************************************************************/
+
+/// Names of the event states, in the order of EVENT_TYPE in events.c
+static const char* decode_event_states[] = {"idle", "running", "pending"};
+/// Names of the overrun actions, in the order of event_overrun_t
+static const char* decode_actions[] = {"report", "demote", "skip"};
+/// Names of the GPIO types, in the order of gpio_type_t
+static const char* decode_gpio_types[] = {"output", "input", "analog"};
+
+/*****************************************************************************/
+/* Communication Functions                                                   */
+/*****************************************************************************/
+
+static const char* decode_name(const char** names, unsigned int len, unsigned int value) {
+    return value < len ? names[value] : "?";
+}
+
+static void decode_events(const unsigned char* record, uint16_t count, uint8_t size) {
+    uint16_t i;
+    printf("# %-5s %6s %-8s %5s %-7s %-6s %10s %10s %8s %10s %12s\n", "event", "module", "priority",
+            "level", "state", "action", "triggers", "runs", "overrun", "last_ns", "total_us");
+    for (i = 0; i < count; ++i, record += size) {
+        if (decode_u16(record) == DECODE_PADDING) {
+            continue;
+        }
+        printf("  %-5u %6u %-8s %5u %-7s %-6s %10u %10u %8u %10u %12u\n", decode_u16(record),
+                decode_u16(record + 2),
+                decode_name(decode_priorities, LNG_EVENTPRIORITY, record[4]), record[5],
+                decode_name(decode_event_states, 3, record[6]), decode_name(decode_actions, 3, record[7]),
+                decode_u32(record + 8), decode_u32(record + 12), decode_u16(record + 16),
+                decode_u32(record + 18), decode_u32(record + 22));
+    }
+}
+
+static void decode_tasks(const unsigned char* record, uint16_t count, uint8_t size) {
+    uint16_t i;
+    printf("# %-5s %6s %-6s %10s %8s %8s\n", "task", "event", "status", "frequency", "counter", "period");
+    for (i = 0; i < count; ++i, record += size) {
+        if (decode_u16(record) == DECODE_PADDING) {
+            continue;
+        }
+        printf("  %-5u %6u %-6s %10u %8u %8u\n", decode_u16(record), decode_u16(record + 2),
+                record[4] ? "run" : "stop", decode_u32(record + 6), decode_u16(record + 10),
+                decode_u16(record + 12));
+    }
+}
+
+static void decode_modules(const unsigned char* record, uint16_t count, uint8_t size) {
+    char name[SNAPSHOT_NAME_SIZE + 1];
+    uint16_t i;
+    printf("# %-6s %6s %s\n", "module", "hash", "name");
+    for (i = 0; i < count; ++i, record += size) {
+        memcpy(name, record + 4, SNAPSHOT_NAME_SIZE);
+        name[SNAPSHOT_NAME_SIZE] = '\0';
+        printf("  %-6u %6.4x %s\n", decode_u16(record), decode_u16(record + 2), name);
+    }
+}
+
+static void decode_i2c(const unsigned char* record, uint16_t count, uint8_t size) {
+    const unsigned char* counters;
+    uint16_t i;
+    uint8_t levels, level;
+    for (i = 0; i < count; ++i, record += size) {
+        levels = record[1];
+        if (2 + 6 * levels + 14 > size) {
+            printf("# i2c record of %u bytes for %u queues, skipped\n", size, levels);
+            continue;
+        }
+        printf("# i2c state %s\n", record[0] < DECODE_I2C_STATES ? decode_i2c_states[record[0]] : "unknown");
+        printf("# %-5s %5s %8s %10s %10s\n", "queue", "used", "max_used", "submitted", "rejected");
+        for (level = 0; level < levels; ++level) {
+            printf("  %-5u %5u %8u %10u %10u\n", level, record[2 + 6 * level], record[3 + 6 * level],
+                    decode_u16(record + 4 + 6 * level), decode_u16(record + 6 + 6 * level));
+        }
+        counters = record + 2 + 6 * levels;
+        printf("# %12s %8s %8s %10s %8s %8s %8s\n", "transactions", "failed", "nacks", "collisions",
+                "resets", "timeouts", "retries");
+        printf("  %12u %8u %8u %10u %8u %8u %8u\n", decode_u16(counters), decode_u16(counters + 2),
+                decode_u16(counters + 4), decode_u16(counters + 6), decode_u16(counters + 8),
+                decode_u16(counters + 10), decode_u16(counters + 12));
+    }
+}
+
+static void decode_gpio(const unsigned char* record, uint16_t count, uint8_t size) {
+    uint16_t i;
+    printf("# %-4s %4s %-6s %4s %4s %4s %6s\n", "port", "pin", "type", "tris", "lat", "port", "analog");
+    for (i = 0; i < count; ++i, record += size) {
+        printf("  %-4u %4u %-6s %4u %4u %4u ", record[0], record[1],
+                decode_name(decode_gpio_types, 3, record[2]), record[3], record[4], record[5]);
+        if (decode_u16(record + 6) == 0xFFFF) {
+            printf("%6s\n", "-");
+        } else {
+            printf("%6u\n", decode_u16(record + 6));
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned char* data;
+    const unsigned char* section;
+    FILE* file;
+    long length;
+    uint16_t size, count;
+    uint8_t sections, type, record_size, i;
+    if (argc < 2) {
+        fprintf(stderr, "usage: snapshot_decode <snapshot>\n");
+        return EXIT_FAILURE;
+    }
+    file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+    fseek(file, 0, SEEK_END);
+    length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data = malloc(length > 0 ? length : 1);
+    if (data == NULL || fread(data, 1, length, file) != (size_t) length) {
+        fprintf(stderr, "snapshot_decode: can not read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    fclose(file);
+    if (length < SNAPSHOT_HEADER_SIZE || decode_u16(data) != SNAPSHOT_MAGIC || data[2] != SNAPSHOT_VERSION) {
+        fprintf(stderr, "snapshot_decode: %s is not a snapshot of version %d\n", argv[1], SNAPSHOT_VERSION);
+        return EXIT_FAILURE;
+    }
+    sections = data[3];
+    size = decode_u16(data + 4);
+    if (size > length) {
+        fprintf(stderr, "snapshot_decode: %s is truncated\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    printf("# snapshot of %u bytes at tick %u\n", size, decode_u32(data + 8));
+    section = data + SNAPSHOT_HEADER_SIZE;
+    for (i = 0; i < sections; ++i) {
+        if (section + SNAPSHOT_SECTION_SIZE > data + size) {
+            fprintf(stderr, "snapshot_decode: %s is corrupted\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+        type = section[0];
+        record_size = section[1];
+        count = decode_u16(section + 2);
+        section += SNAPSHOT_SECTION_SIZE;
+        if (section + (size_t) record_size * count > data + size) {
+            fprintf(stderr, "snapshot_decode: %s is corrupted\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+        printf("\n");
+        switch (type) {
+            case SNAPSHOT_EVENTS:
+                if (record_size >= SNAPSHOT_EVENT_SIZE) {
+                    decode_events(section, count, record_size);
+                }
+                break;
+            case SNAPSHOT_TASKS:
+                if (record_size >= SNAPSHOT_TASK_SIZE) {
+                    decode_tasks(section, count, record_size);
+                }
+                break;
+            case SNAPSHOT_MODULES:
+                if (record_size >= SNAPSHOT_MODULE_SIZE) {
+                    decode_modules(section, count, record_size);
+                }
+                break;
+            case SNAPSHOT_I2C:
+                if (record_size >= 2) {
+                    decode_i2c(section, count, record_size);
+                }
+                break;
+            case SNAPSHOT_GPIO:
+                if (record_size >= SNAPSHOT_GPIO_SIZE) {
+                    decode_gpio(section, count, record_size);
+                }
+                break;
+            default:
+                printf("# section %u of %u records, skipped\n", type, count);
+                break;
+        }
+        section += (size_t) record_size * count;
+    }
+    free(data);
+    return EXIT_SUCCESS;
+}
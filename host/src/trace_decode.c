@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+ */
+
+/*
+ * Decoder of a dump of the kernel trace (system/trace.h) to the trace
+ * event JSON of Chrome and Perfetto (chrome://tracing, ui.perfetto.dev).
+ * The callbacks are slices on a track for each event priority, the
+ * triggers and the task releases are instants, the states of each I2C
+ * bus are slices on a track of the bus.
+ *
+ *     trace_decode dump.trace > dump.json
+ */
+
+/******************************************************************************/
+/* Files to Include                                                           */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "system/trace.h"
+#include "decode/decode.h"
+
+/// Size of the header in the dump
+#define DECODE_HEADER_SIZE 20
+/// Track of the task releases and first track of the I2C buses
+#define DECODE_TRACK_TASKS 10
+#define DECODE_TRACK_I2C 20
+/// Max number of I2C buses
+#define DECODE_MAX_BUSES 8
+
+/// Track of an I2C bus
+typedef struct _decode_bus {
+    uint16_t id;                ///< Bus in the records
+    uint8_t state;              ///< State in progress, TRACE_I2C_UNKNOWN if none
+} decode_bus_t;
+
+/******************************************************************************/
+/* Global Variable Declaration                                                */
+/******************************************************************************/
+
+/// Callbacks in progress on each priority, a start for each nested level
+unsigned int decode_open[LNG_EVENTPRIORITY];
+decode_bus_t decode_buses[DECODE_MAX_BUSES];
+unsigned int decode_bus_counter = 0;
+/// Separator of the JSON array
+const char* decode_separator = "";
+
+/*****************************************************************************/
+/* Communication Functions                                                   */
+/*****************************************************************************/
+
+/**
+ * Print an event of the JSON array
+ * @param phase B, E, i or M
+ * @param track thread of the event
+ * @param us time in microseconds
+ * @param name name of the event, NULL for an end
+ * @param id event, task or bus to show in the arguments
+ */
+static void decode_print(char phase, unsigned int track, double us, const char* name, unsigned int id) {
+    printf("%s\n{\"ph\":\"%c\",\"pid\":0,\"tid\":%u,\"ts\":%.3f", decode_separator, phase, track, us);
+    if (name != NULL) {
+        printf(",\"name\":\"%s\",\"args\":{\"id\":%u}", name, id);
+    }
+    if (phase == 'i') {
+        printf(",\"s\":\"t\"");
+    }
+    printf("}");
+    decode_separator = ",";
+}
+/**
+ * Name of a track
+ */
+static void decode_track(unsigned int track, const char* name) {
+    printf("%s\n{\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+            decode_separator, track, name);
+    decode_separator = ",";
+}
+/**
+ * Track of a bus, new at the first record
+ * @return NULL if there are too many buses
+ */
+static decode_bus_t* decode_bus(uint16_t id, unsigned int* track) {
+    char name[16];
+    unsigned int i;
+    for (i = 0; i < decode_bus_counter; ++i) {
+        if (decode_buses[i].id == id) {
+            *track = DECODE_TRACK_I2C + i;
+            return &decode_buses[i];
+        }
+    }
+    if (decode_bus_counter == DECODE_MAX_BUSES) {
+        return NULL;
+    }
+    decode_buses[i].id = id;
+    decode_buses[i].state = TRACE_I2C_UNKNOWN;
+    *track = DECODE_TRACK_I2C + i;
+    snprintf(name, sizeof(name), "I2C %04x", id);
+    decode_track(*track, name);
+    decode_bus_counter++;
+    return &decode_buses[i];
+}
+/**
+ * Decode a record
+ * @param record record in the dump
+ * @param us time of the record
+ */
+static void decode_record(const unsigned char* record, double us) {
+    uint8_t type = record[4];
+    uint8_t arg = record[5];
+    uint16_t id = decode_u16(record + 6);
+    char name[32];
+    decode_bus_t* bus;
+    unsigned int track;
+    switch (type) {
+        case TRACE_TRIGGER:
+        case TRACE_START:
+        case TRACE_END:
+            if (arg >= LNG_EVENTPRIORITY) {
+                break;
+            }
+            if (type == TRACE_TRIGGER) {
+                snprintf(name, sizeof(name), "trigger %u", id);
+                decode_print('i', arg, us, name, id);
+            } else if (type == TRACE_START) {
+                snprintf(name, sizeof(name), "event %u", id);
+                decode_print('B', arg, us, name, id);
+                decode_open[arg]++;
+            } else if (decode_open[arg] > 0) {
+                // The start can be before the oldest record
+                decode_print('E', arg, us, NULL, id);
+                decode_open[arg]--;
+            }
+            break;
+        case TRACE_RELEASE:
+            snprintf(name, sizeof(name), "task %u", id);
+            decode_print('i', DECODE_TRACK_TASKS, us, name, id);
+            break;
+        case TRACE_I2C_STATE:
+            bus = decode_bus(id, &track);
+            if (bus == NULL) {
+                break;
+            }
+            if (bus->state != TRACE_I2C_UNKNOWN) {
+                decode_print('E', track, us, NULL, id);
+            }
+            // The idle bus is an empty space on the track
+            bus->state = TRACE_I2C_UNKNOWN;
+            if (arg != 0) {
+                decode_print('B', track, us, arg < DECODE_I2C_STATES ? decode_i2c_states[arg] : "unknown", id);
+                bus->state = arg;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned char* data;
+    FILE* file;
+    long length;
+    uint16_t size, head, period, tick, last_tick = 0;
+    uint32_t count, frequency, records, i;
+    uint8_t record_size;
+    uint64_t ticks = 0;
+    double us, last_us = 0;
+    const unsigned char* record;
+    if (argc < 2) {
+        fprintf(stderr, "usage: trace_decode <dump>\n");
+        return EXIT_FAILURE;
+    }
+    file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+    fseek(file, 0, SEEK_END);
+    length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data = malloc(length > 0 ? length : 1);
+    if (data == NULL || fread(data, 1, length, file) != (size_t) length) {
+        fprintf(stderr, "trace_decode: can not read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    fclose(file);
+    if (length < DECODE_HEADER_SIZE || decode_u16(data) != TRACE_MAGIC || data[2] != TRACE_VERSION) {
+        fprintf(stderr, "trace_decode: %s is not a trace of version %d\n", argv[1], TRACE_VERSION);
+        return EXIT_FAILURE;
+    }
+    record_size = data[3];
+    size = decode_u16(data + 4);
+    head = decode_u16(data + 6);
+    count = decode_u32(data + 8);
+    frequency = decode_u32(data + 12);
+    period = decode_u16(data + 16);
+    if (record_size < sizeof(trace_record_t) || frequency == 0 || period == 0 || head >= size
+            || length < DECODE_HEADER_SIZE + (long) size * record_size) {
+        fprintf(stderr, "trace_decode: %s is truncated or corrupted\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    // Oldest record first
+    records = count < size ? count : size;
+    printf("{\"displayTimeUnit\":\"ns\",\"otherData\":{\"records\":%u,\"lost\":%u},\"traceEvents\":[",
+            records, count - records);
+    for (i = 0; i < LNG_EVENTPRIORITY; ++i) {
+        decode_track(i, decode_priorities[i]);
+    }
+    decode_track(DECODE_TRACK_TASKS, "tasks");
+    for (i = 0; i < records; ++i) {
+        record = data + DECODE_HEADER_SIZE + ((count < size ? i : head + i) % size) * record_size;
+        tick = decode_u16(record);
+        // The ticks are a word, in order along the ring
+        ticks += (uint16_t) (tick - last_tick);
+        last_tick = tick;
+        us = (ticks + (double) decode_u16(record + 2) / period) * 1e6 / frequency;
+        // A record between the timer overflow and the tick goes back of a period
+        if (us < last_us) {
+            us = last_us;
+        }
+        last_us = us;
+        decode_record(record, us);
+    }
+    printf("\n]}\n");
+    free(data);
+    return EXIT_SUCCESS;
+}
@@ -69,6 +69,8 @@ extern "C" {
     #define REGISTER_MASK_TOGGLE(reg, mask)   (*(reg) ^= (mask))
     /// Read bits in register with selected mask
     #define REGISTER_MASK_READ(reg, mask)     ((*(reg) & (mask)) == (mask))
+    /// Write value only on the bits selected from mask, in a single access
+    #define REGISTER_MASK_WRITE(reg, mask, value) (*(reg) = (*(reg) & ~(mask)) | ((value) & (mask)))
     /// Callback to configure the ADC
     typedef bool (*gpio_adc_callbackFunc_t)(void);
     /**
@@ -140,6 +142,9 @@ extern "C" {
         size_t len;
     } gp_port_def_t;
     
+    /// Snapshot in progress, in system/snapshot.h
+    struct _snapshot;
+
 /******************************************************************************/
 /* System Function Prototypes                                                 */
 /******************************************************************************/
@@ -198,6 +203,11 @@ extern "C" {
      * @param value
      */
     inline void gpio_ProcessADCSamples(short idx, int value);
+    /**
+     * Write the section of the pins of the ports in gpio_init
+     * @param snapshot snapshot in progress, in system/snapshot.h
+     */
+    void gpio_snapshot(struct _snapshot* snapshot);
 
 #ifdef	__cplusplus
 }
@@ -13,26 +13,202 @@ extern "C" {
 #endif
     
     #include <system/events.h>
+    #include <system/task_manager.h>
 
 /******************************************************************************/
 /* System Level #define Macros                                                */
 /******************************************************************************/
-    /// State of I2C command
+    /// Depth of the I2C queue (power of two)
+    #ifndef I2C_QUEUE_DEPTH
+    #define I2C_QUEUE_DEPTH 8
+    #endif
+    /// Depth of the I2C queue for high priority messages (power of two)
+    #ifndef I2C_QUEUE_HIGH_DEPTH
+    #define I2C_QUEUE_HIGH_DEPTH 4
+    #endif
+    /// Number of I2C priorities
+    #define I2C_PRIORITY_LEVELS 2
+
+    /// Priority of I2C message, high priority messages are served first
     typedef enum {
-        FALSE = 0,      ///< I2C can't send the message
-        TRUE = 1,       ///< I2C send the message
-        PENDING = 2     ///< Message in pending
-    } i2c_state_t;
+        I2C_PRIORITY_NORMAL = 0,    ///< FIFO with all messages
+        I2C_PRIORITY_HIGH = 1,      ///< Time critical messages
+    } i2c_priority_t;
+
+    /// Counters for each I2C queue
+    typedef struct _i2c_queue_stats {
+        uint16_t submitted;         ///< Messages accepted in queue
+        uint16_t rejected;          ///< Messages rejected, queue full
+        uint8_t used;               ///< Messages in queue
+        uint8_t max_used;           ///< Max number of messages in queue
+    } i2c_queue_stats_t;
     
-    /// callback type for I2C user
-    typedef void (*I2C_callbackFunc)(bool);
+    /// Clock pulses to release a peripheral that holds SDA low
+    #define I2C_RECOVERY_PULSES 9
+    /// Busy loop for half period of the recovery clock
+    #ifndef I2C_RECOVERY_DELAY
+    #define I2C_RECOVERY_DELAY 40
+    #endif
+
+    /// Policy for the messages when the bus is recovered
+    typedef enum {
+        I2C_RECOVERY_FAIL = 0,      ///< Fail the transaction and all messages in queue
+        I2C_RECOVERY_RETRY = 1,     ///< Retry the transaction, keep the messages in queue
+    } i2c_recovery_policy_t;
+
+    /// Configuration of the timeout and of the recovery of a bus
+    typedef struct _i2c_recovery {
+        gpio_t* scl;                ///< SCL pin, NULL to skip the clock pulses
+        gpio_t* sda;                ///< SDA pin
+        uint16_t timeout;           ///< Max ticks of a transaction, 0 disabled
+        i2c_recovery_policy_t policy; ///< Policy for the messages
+        unsigned char retries;      ///< Max retries of a transaction
+    } i2c_recovery_t;
+
+    /// Number of peripherals with statistics on each bus
+    #ifndef I2C_DEVICE_STATS
+    #define I2C_DEVICE_STATS 8
+    #endif
+
+    /// Latency of the transactions in [uS], on the timer of init_events
+    typedef struct _i2c_latency {
+        uint32_t total;             ///< Sum of all latencies
+        uint16_t max;               ///< Max latency, up to 65535
+    } i2c_latency_t;
+
+    /// Counters of a bus
+    typedef struct _i2c_bus_stats {
+        uint32_t bytes_tx;          ///< Bytes sent, with the address bytes
+        uint32_t bytes_rx;          ///< Bytes received
+        uint32_t interrupts;        ///< Steps of the state machine
+        uint16_t transactions;      ///< Transactions completed
+        uint16_t failed;            ///< Transactions failed
+        uint16_t nacks;             ///< Peripherals not responding
+        uint16_t collisions;        ///< Bus collisions
+        uint16_t resets;            ///< Resets of the controller
+        uint16_t timeouts;          ///< Transactions expired
+        uint16_t retries;           ///< Transactions restarted after a recovery
+        i2c_latency_t queue_wait;   ///< From the submission to the start
+        i2c_latency_t bus_time;     ///< From the start to the stop
+    } i2c_bus_stats_t;
+
+    /// Counters of a peripheral on the bus
+    typedef struct _i2c_device_stats {
+        unsigned char command;      ///< Command usually the address of peripheral
+        uint16_t transactions;      ///< Transactions completed
+        uint16_t failed;            ///< Transactions failed
+        uint32_t bytes;             ///< Bytes sent and received
+        uint32_t bus_time;          ///< Sum of bus time in [uS]
+    } i2c_device_stats_t;
+
+    /// Handle of an I2C request
+    typedef uint16_t hI2C_t;
+    /// Request not accepted
+    #define INVALID_I2C_HANDLE 0xFFFF
+    /**
+     * Callback type for I2C user, launched at the end of the request
+     * @param request handle returned from the submission
+     * @param state true if the request is completed
+     * @param bytes data bytes sent and received, without the address bytes
+     * @param context user data of the submission
+     */
+    typedef void (*I2C_callbackFunc)(hI2C_t request, bool state, unsigned int bytes, void* context);
+    /// Additional operation when the controller is reset
+    typedef void (*I2C_resetFunc)(bool);
+
+    /// Segment to write on the peripheral
+    #define I2C_SEGMENT_WRITE   0
+    /// Segment to read from the peripheral
+    #define I2C_SEGMENT_READ    1
+    /// Force a repeated start before the segment
+    #define I2C_SEGMENT_RESTART 2
+
+    /**
+     * Segment of a transaction. Consecutive segments with the same command
+     * and direction are sent in the same phase of the bus (scatter-gather),
+     * otherwise the controller sends a repeated start.
+     */
+    typedef struct _i2c_segment {
+        unsigned char command;      ///< Command usually the address of peripheral
+        unsigned char flags;        ///< I2C_SEGMENT_WRITE or I2C_SEGMENT_READ, with I2C_SEGMENT_RESTART
+        unsigned char* pData;       ///< Data to write or buffer to read
+        unsigned int size;          ///< Size of data, at least one byte for read
+    } i2c_segment_t;
     
+    /// Context of an I2C bus
+    typedef struct _i2c_bus i2c_bus_t;
+    /// Step of the I2C state machine
+    typedef void (*i2c_state_func_t)(i2c_bus_t* bus);
+    /// Message in the I2C queue
+    typedef struct _i2c_message {
+        i2c_segment_t* segments;    ///< Segments of a transaction, NULL for a single message
+        unsigned char count;        ///< Number of segments
+        i2c_segment_t message[2];   ///< Command and data of a single message
+        I2C_callbackFunc pCallback; ///< Callback
+        void* context;              ///< User data for the callback
+        hI2C_t handle;              ///< Handle of the request
+        event_stamp_t submitted;    ///< Instant of the submission
+    } i2c_message_t;
+    /**
+     * Ring of I2C messages. Head and tail are free running indexes, both
+     * moved with the I2C interrupt masked: the head from the submission,
+     * at any priority, and the tail only from the owner of the bus (busy),
+     * the I2C interrupt or the caller that took the bus from submission
+     * or from the watchdog.
+     */
+    typedef struct _i2c_ring {
+        i2c_message_t* buffer;      ///< Messages in queue
+        uint8_t mask;               ///< Depth - 1
+        volatile uint8_t head;      ///< Next free message
+        volatile uint8_t tail;      ///< Next message to serve
+        i2c_queue_stats_t stats;    ///< Backpressure counters
+    } i2c_ring_t;
+    /**
+     * Context of an I2C bus, allocated from the user and initialized with
+     * I2C_Init. Each bus has its own registers, state machine, queues and
+     * service event, so the buses run in parallel.
+     */
+    struct _i2c_bus {
+        hardware_bit_t* INTERRUPT;  ///< I2C interrupt line
+        REGISTER CON;               ///< I2C configuration register
+        REGISTER STAT;              ///< I2C status register
+        REGISTER TRN;               ///< I2C transmission register
+        REGISTER RCV;               ///< I2C reception register
+        I2C_resetFunc reset_callback; ///< Additional operation when reset I2C
+        hEvent_t service;           ///< I2C service event
+        event_arg_t arg;            ///< Argument of the events, the bus itself
+        hEvent_t watchdog;          ///< Timeout check event
+        i2c_recovery_t recovery;    ///< Timeout and recovery configuration
+        unsigned char attempt;      ///< Retries of the current transaction
+        i2c_state_func_t state;     ///< State of the bus
+        volatile bool busy;         ///< Bus busy, set true until initialized
+        i2c_message_t current;      ///< Message in transmission
+        i2c_segment_t* segment;     ///< Segment in transmission
+        unsigned char segments_left; ///< Segments left, with the current one
+        unsigned int index;         ///< Index into the segment buffer
+        int error;                  ///< Last error
+        event_stamp_t started;      ///< Instant of the start of the transaction
+        uint16_t bytes;             ///< Bytes of the transaction
+        unsigned int transferred;   ///< Data bytes of the transaction
+        hI2C_t next_handle;         ///< Handle of the next request
+        i2c_bus_stats_t stats;      ///< Counters of the bus
+        unsigned char devices_used; ///< Peripherals with statistics
+        i2c_device_stats_t devices[I2C_DEVICE_STATS]; ///< Counters of each peripheral
+        i2c_ring_t ring[I2C_PRIORITY_LEVELS]; ///< Queues for each priority
+        i2c_message_t queue[I2C_QUEUE_DEPTH]; ///< Buffer I2C queue
+        i2c_message_t queue_high[I2C_QUEUE_HIGH_DEPTH]; ///< Buffer high priority queue
+    };
+    
+    /// Snapshot in progress, in system/snapshot.h
+    struct _snapshot;
+
 /******************************************************************************/
 /* System Function Prototypes                                                 */
 /******************************************************************************/
 
     /**
      * Initialize the I2C peripheral and trigger the I2C service routine to run
+     * @param bus context of the bus
      * @param i2c_interrupt I2C interrupt line
      * @param i2c_con I2C configuration register
      * @param i2c_stat I2C status register
@@ -41,54 +217,175 @@ extern "C" {
      * @param resetCallback additional operation when reset I2C
      * @return Number event
      */
-    hEvent_t I2C_Init(hardware_bit_t* i2c_interrupt, REGISTER i2c_con, REGISTER i2c_stat, REGISTER i2c_trn, REGISTER i2c_rcv, I2C_callbackFunc resetCallback);
+    hEvent_t I2C_Init(i2c_bus_t* bus, hardware_bit_t* i2c_interrupt, REGISTER i2c_con, REGISTER i2c_stat, REGISTER i2c_trn, REGISTER i2c_rcv, I2C_resetFunc resetCallback);
     
+    /**
+     * Enable the timeout of the transactions and the automatic recovery of
+     * the bus. A task checks the bus; when a transaction runs over the
+     * timeout, or the controller is stuck with messages in queue, the bus
+     * is aborted, the SCL pin clocks out the peripheral holding SDA and the
+     * controller is initialized again.
+     * @param bus context of the bus
+     * @param recovery configuration, copied in the bus
+     * @param frequency frequency of the check
+     * @return handle of the task, INVALID_TASK_HANDLE on failure
+     */
+    hTask_t I2C_setRecovery(i2c_bus_t* bus, const i2c_recovery_t* recovery, frequency_t frequency);
+
+    /**
+     * Abort the transaction and recover the bus, the messages are failed or
+     * retried according to the policy
+     * @param bus context of the bus
+     */
+    void I2C_reset(i2c_bus_t* bus);
+
     /**
      * Check for I2C ACK on command
+     * @param bus context of the bus
      * @param command command data usually the address of peripherals
      * @param pCallback callback received
-     * @return state of I2C
+     * @param context user data for the callback
+     * @return handle of the request, INVALID_I2C_HANDLE if the queue is full
      */
-    bool I2C_checkACK(unsigned int command, I2C_callbackFunc pCallback);
+    hI2C_t I2C_checkACK(i2c_bus_t* bus, unsigned int command, I2C_callbackFunc pCallback, void* context);
 
     /**
      * Write command without additional data
+     * @param bus context of the bus
      * @param command command data usually the address of peripherals
      * @param pcommandData additional message
      * @param commandDataSize size of additional message
      * @param pCallback Callback when the controller complete or fail to send the message
-     * @return status of sending message
+     * @param context user data for the callback
+     * @return handle of the request, INVALID_I2C_HANDLE if the queue is full
      */
-    i2c_state_t I2C_Write(unsigned char command, unsigned char* pcommandData, unsigned char commandDataSize, I2C_callbackFunc pCallback);
+    hI2C_t I2C_Write(i2c_bus_t* bus, unsigned char command, unsigned char* pcommandData, unsigned char commandDataSize, I2C_callbackFunc pCallback, void* context);
     
     /**
      * Write a message with additional data
+     * @param bus context of the bus
+     * @param command command data usually the address of peripherals
+     * @param pcommandData additional message
+     * @param commandDataSize size of additional message
+     * @param ptxData pointer to transmission data
+     * @param txSize size of data
+     * @param pCallback Callback when the controller complete or fail to send the message
+     * @param context user data for the callback
+     * @return handle of the request, INVALID_I2C_HANDLE if the queue is full
+     */
+    hI2C_t I2C_Write_data(i2c_bus_t* bus, unsigned char command, unsigned char* pcommandData, unsigned char commandDataSize, unsigned char* ptxData, unsigned int txSize, I2C_callbackFunc pCallback, void* context);
+
+    /**
+     * Write a message with additional data and priority
+     * @param bus context of the bus
      * @param command command data usually the address of peripherals
      * @param pcommandData additional message
      * @param commandDataSize size of additional message
      * @param ptxData pointer to transmission data
      * @param txSize size of data
      * @param pCallback Callback when the controller complete or fail to send the message
-     * @return status of sending message
+     * @param context user data for the callback
+     * @param priority queue of the message
+     * @return handle of the request, INVALID_I2C_HANDLE if the queue is full
      */
-    i2c_state_t I2C_Write_data(unsigned char command, unsigned char* pcommandData, unsigned char commandDataSize, unsigned char* ptxData, unsigned int txSize, I2C_callbackFunc pCallback);
+    hI2C_t I2C_Write_data_p(i2c_bus_t* bus, unsigned char command, unsigned char* pcommandData, unsigned char commandDataSize, unsigned char* ptxData, unsigned int txSize, I2C_callbackFunc pCallback, void* context, i2c_priority_t priority);
     
     /**
-     * 
+     * Read a message. Messages are served in order of submission.
+     * @param bus context of the bus
      * @param command command data usually the address of peripherals
      * @param pcommandData additional message
      * @param commandDataSize size of additional message
      * @param prxData pointer to received data
      * @param rxSize size of data
      * @param pCallback Callback when the controller complete or fail to send the message
-     * @return status of sending message
+     * @param context user data for the callback
+     * @return handle of the request, INVALID_I2C_HANDLE if the queue is full
+     */
+    hI2C_t I2C_Read(i2c_bus_t* bus, unsigned char command, unsigned char* pcommandData, unsigned char commandDataSize, unsigned char* prxData, unsigned int rxSize, I2C_callbackFunc pCallback, void* context);
+
+    /**
+     * Read a message with priority
+     * @param bus context of the bus
+     * @param command command data usually the address of peripherals
+     * @param pcommandData additional message
+     * @param commandDataSize size of additional message
+     * @param prxData pointer to received data
+     * @param rxSize size of data
+     * @param pCallback Callback when the controller complete or fail to send the message
+     * @param context user data for the callback
+     * @param priority queue of the message
+     * @return handle of the request, INVALID_I2C_HANDLE if the queue is full
+     */
+    hI2C_t I2C_Read_p(i2c_bus_t* bus, unsigned char command, unsigned char* pcommandData, unsigned char commandDataSize, unsigned char* prxData, unsigned int rxSize, I2C_callbackFunc pCallback, void* context, i2c_priority_t priority);
+
+    /**
+     * Run a list of segments in a single bus transaction, with only one
+     * start and one stop. The segments and their buffers must be available
+     * until the callback.
+     * @param bus context of the bus
+     * @param segments list of segments
+     * @param count number of segments
+     * @param pCallback Callback when the controller complete or fail the transaction
+     * @param context user data for the callback
+     * @return handle of the request, INVALID_I2C_HANDLE if the queue is full
+     */
+    hI2C_t I2C_Transaction(i2c_bus_t* bus, i2c_segment_t* segments, unsigned char count, I2C_callbackFunc pCallback, void* context);
+
+    /**
+     * Run a list of segments in a single bus transaction with priority
+     * @param bus context of the bus
+     * @param segments list of segments
+     * @param count number of segments
+     * @param pCallback Callback when the controller complete or fail the transaction
+     * @param context user data for the callback
+     * @param priority queue of the transaction
+     * @return handle of the request, INVALID_I2C_HANDLE if the queue is full
+     */
+    hI2C_t I2C_Transaction_p(i2c_bus_t* bus, i2c_segment_t* segments, unsigned char count, I2C_callbackFunc pCallback, void* context, i2c_priority_t priority);
+
+    /**
+     * Copy the counters of a queue
+     * @param bus context of the bus
+     * @param priority queue to read
+     * @param stats destination of the counters
+     */
+    void I2C_getQueueStats(i2c_bus_t* bus, i2c_priority_t priority, i2c_queue_stats_t* stats);
+
+    /**
+     * Copy the counters and the latencies of the bus
+     * @param bus context of the bus
+     * @param stats destination of the counters
+     */
+    void I2C_getBusStats(i2c_bus_t* bus, i2c_bus_stats_t* stats);
+
+    /**
+     * Copy the counters of the peripherals on the bus, to find the
+     * peripheral that saturates the bus
+     * @param bus context of the bus
+     * @param stats destination of the counters
+     * @param len max number of peripherals to copy
+     * @return number of peripherals copied
+     */
+    unsigned char I2C_getDeviceStats(i2c_bus_t* bus, i2c_device_stats_t* stats, unsigned char len);
+
+    /**
+     * Clear all counters of the bus and of the peripherals
+     * @param bus context of the bus
+     */
+    void I2C_resetStats(i2c_bus_t* bus);
+    /**
+     * Write the section of the bus, source of snapshot_register
+     * @param snapshot snapshot in progress
+     * @param bus context of the bus
      */
-    i2c_state_t I2C_Read(unsigned char command, unsigned char* pcommandData, unsigned char commandDataSize, unsigned char* prxData, unsigned int rxSize, I2C_callbackFunc pCallback);
+    void I2C_snapshot(struct _snapshot* snapshot, void* bus);
 
     /**
      * This function you must add in I2C interrupt
+     * @param bus context of the bus
      */
-    inline void I2C_manager (void);
+    inline void I2C_manager (i2c_bus_t* bus);
 
 #ifdef	__cplusplus
 }
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef I2C_POLL_H
+#define	I2C_POLL_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>        /* Includes uint16_t definition                    */
+#include <stdbool.h>       /* Includes true/false definition                  */
+
+#include "peripherals/i2c_controller.h"
+#include "system/task_manager.h"
+
+/******************************************************************************/
+/* System Level #define Macros                                                */
+/******************************************************************************/
+    /// Max size of a sample
+    #ifndef I2C_POLL_MAX_SIZE
+    #define I2C_POLL_MAX_SIZE 16
+    #endif
+    /// Age of a poll without samples
+    #define I2C_POLL_NO_SAMPLE 0xFFFFFFFF
+
+    /**
+     * Periodic read of a peripheral. The I2C controller writes the new
+     * sample in the back buffer, at the end of the read the buffers are
+     * swapped and the sequence is updated. The sequence changes at the start
+     * and at the end of every read, the readers check it to never return a
+     * sample in writing.
+     */
+    typedef struct _i2c_poll {
+        i2c_bus_t* bus;                     ///< Bus of the peripheral
+        unsigned char command;              ///< Command usually the address of peripheral
+        unsigned char reg;                  ///< Register to read
+        unsigned char size;                 ///< Size of the sample
+        hEvent_t event;                     ///< Event to start the read
+        hTask_t task;                       ///< Task with the rate of the read
+        volatile bool reading;              ///< Read in queue or on the bus
+        volatile uint8_t front;             ///< Buffer with the last sample
+        volatile uint16_t sequence;         ///< Number of buffer updates
+        uint32_t timestamp[2];              ///< Tick of the sample in each buffer
+        uint16_t samples;                   ///< Number of samples
+        uint16_t failed;                    ///< Failed reads
+        uint16_t missed;                    ///< Reads skipped, previous read not complete
+        uint8_t data[2][I2C_POLL_MAX_SIZE]; ///< Double buffer
+    } i2c_poll_t;
+
+/******************************************************************************/
+/* System Function Prototypes                                                 */
+/******************************************************************************/
+    /**
+     * Register a periodic read of a peripheral and start it. The number of
+     * polls is bounded from the free events and tasks.
+     * @param poll poll to register, allocated from the user
+     * @param bus context of the bus
+     * @param command command usually the address of peripheral
+     * @param reg register to read
+     * @param size size of the sample, max I2C_POLL_MAX_SIZE
+     * @param rate frequency of the read
+     * @return task of the read, INVALID_TASK_HANDLE if not registered
+     */
+    hTask_t I2C_poll_register(i2c_poll_t* poll, i2c_bus_t* bus, unsigned char command, unsigned char reg, unsigned char size, frequency_t rate);
+    /**
+     * Copy the last sample, without stop any interrupt
+     * @param poll registered poll
+     * @param data destination of the sample, poll->size bytes
+     * @param timestamp tick of the sample, can be NULL
+     * @return false if there are no samples
+     */
+    bool I2C_poll_read(i2c_poll_t* poll, void* data, uint32_t* timestamp);
+    /**
+     * Number of ticks from the last sample
+     * @param poll registered poll
+     * @return age in ticks of task manager, I2C_POLL_NO_SAMPLE without samples
+     */
+    uint32_t I2C_poll_age(i2c_poll_t* poll);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* I2C_POLL_H */
+
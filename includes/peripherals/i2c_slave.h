@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef I2C_SLAVE_H
+#define	I2C_SLAVE_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>        /* Includes uint16_t definition                    */
+#include <stdbool.h>       /* Includes true/false definition                  */
+
+#include "peripherals/gpio.h"
+#include "system/events.h"
+
+/******************************************************************************/
+/* System Level #define Macros                                                */
+/******************************************************************************/
+    /// Value read from a register without region
+    #define I2C_SLAVE_UNMAPPED 0xFF
+    /// The master can only read the region
+    #define I2C_SLAVE_READ_ONLY 0
+    /// The master can read and write the region
+    #define I2C_SLAVE_WRITABLE 1
+    /// Region on a variable of the kernel, without copy
+    #define I2C_SLAVE_REGION(reg, var, flags) {(reg), sizeof(var), (flags), (volatile unsigned char*) &(var)}
+
+    /**
+     * Consecutive registers on a memory area. The master reads and writes
+     * directly the memory, the values larger than a byte can change
+     * between two bytes of the same read: use the read callback to update
+     * a snapshot if it is a problem.
+     */
+    typedef struct _i2c_slave_region {
+        unsigned char reg;              ///< First register of the region
+        unsigned char size;             ///< Number of registers
+        unsigned char flags;            ///< I2C_SLAVE_READ_ONLY or I2C_SLAVE_WRITABLE
+        volatile unsigned char* data;   ///< Memory of the registers
+    } i2c_slave_region_t;
+
+    /// Counters of the slave
+    typedef struct _i2c_slave_stats {
+        uint16_t reads;                 ///< Read transactions from the master
+        uint16_t writes;                ///< Write transactions from the master
+        uint32_t bytes_tx;              ///< Bytes sent
+        uint32_t bytes_rx;              ///< Bytes received, without the address
+        uint16_t rejected;              ///< Bytes written on read only or unmapped registers
+        uint16_t overflows;             ///< Bytes lost, receive overflow
+    } i2c_slave_stats_t;
+
+    typedef struct _i2c_slave i2c_slave_t;
+    /// State of the slave, a function for each step of the bus
+    typedef void (*i2c_slave_state_func_t)(i2c_slave_t* slave);
+    /// Launched in the interrupt before a read, keep it short
+    typedef void (*I2C_slaveReadFunc)(i2c_slave_t* slave, unsigned char reg);
+    /// Launched from the slave event after a write of the master
+    typedef void (*I2C_slaveWriteFunc)(i2c_slave_t* slave, unsigned char reg, unsigned int size);
+    /**
+     * Context of an I2C slave, allocated from the user and initialized with
+     * I2C_slave_Init. The master writes the register pointer with the first
+     * byte of a write, the next bytes are written from the pointer; a read
+     * starts from the pointer. The pointer increases after each byte.
+     */
+    struct _i2c_slave {
+        hardware_bit_t* INTERRUPT;      ///< I2C slave interrupt line
+        REGISTER CON;                   ///< I2C configuration register
+        REGISTER STAT;                  ///< I2C status register
+        REGISTER ADD;                   ///< I2C address register
+        REGISTER TRN;                   ///< I2C transmission register
+        REGISTER RCV;                   ///< I2C reception register
+        hEvent_t service;               ///< Event for the write callback
+        event_arg_t arg;                ///< Argument of the event, the slave itself
+        i2c_slave_state_func_t state;   ///< State of the slave
+        const i2c_slave_region_t* regions; ///< Register file
+        unsigned char regions_len;      ///< Number of regions
+        const i2c_slave_region_t* region; ///< Region of the pointer, NULL if unmapped
+        unsigned char pointer;          ///< Register pointer
+        I2C_slaveReadFunc pRead;        ///< Read callback
+        I2C_slaveWriteFunc pWrite;      ///< Write callback
+        volatile bool written;          ///< Registers written, not notified
+        volatile unsigned char first;   ///< First register written
+        volatile unsigned int size;     ///< Number of registers written, up to 256
+        i2c_slave_stats_t stats;        ///< Counters
+    };
+
+/******************************************************************************/
+/* System Function Prototypes                                                 */
+/******************************************************************************/
+    /**
+     * Initialize the I2C peripheral as slave with a 7 bit address
+     * @param slave context of the slave
+     * @param i2c_interrupt I2C slave interrupt line
+     * @param i2c_con I2C configuration register
+     * @param i2c_stat I2C status register
+     * @param i2c_add I2C address register
+     * @param i2c_trn I2C transmission register
+     * @param i2c_rcv I2C reception register
+     * @param address 7 bit address of the slave
+     * @return Number event
+     */
+    hEvent_t I2C_slave_Init(i2c_slave_t* slave, hardware_bit_t* i2c_interrupt, REGISTER i2c_con, REGISTER i2c_stat, REGISTER i2c_add, REGISTER i2c_trn, REGISTER i2c_rcv, unsigned char address);
+    /**
+     * Set the register file of the slave
+     * @param slave context of the slave
+     * @param regions regions sorted by register, without overlaps
+     * @param len number of regions
+     * @param pRead callback before a read, can be NULL
+     * @param pWrite callback after a write, can be NULL
+     */
+    void I2C_slave_map(i2c_slave_t* slave, const i2c_slave_region_t* regions, unsigned char len, I2C_slaveReadFunc pRead, I2C_slaveWriteFunc pWrite);
+    /**
+     * Copy the counters of the slave
+     * @param slave context of the slave
+     * @param stats destination of the counters
+     */
+    void I2C_slave_getStats(i2c_slave_t* slave, i2c_slave_stats_t* stats);
+    /**
+     * This function you must add in I2C slave interrupt
+     * @param slave context of the slave
+     */
+    inline void I2C_slave_manager(i2c_slave_t* slave);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* I2C_SLAVE_H */
+
@@ -36,21 +36,99 @@ extern "C" {
     #define LED_ALWAYS_HIGH -1
     /// Set off led
     #define LED_OFF 0
+    /// Led driven from a custom pattern
+    #define LED_PATTERN -2
+    /// Number of pattern slots in one second
+    #define LED_PATTERN_SLOTS 16
+    /// Length of a blink code: one second of blinks and half second off
+    #define LED_PATTERN_CYCLE (3 * LED_PATTERN_SLOTS / 2)
+    /// Max number of blinks in a blink code
+    #define LED_PATTERN_MAX_BLINK (LED_PATTERN_SLOTS / 2)
+    /// Max brightness of a led
+    #define LED_BRIGHTNESS_MAX 255
+    /// Number of controller calls in a PWM period (power of two, max 128)
+    #ifndef LED_PWM_STEPS
+    #define LED_PWM_STEPS 16
+    #endif
+
+    /**
+     * Sequence of slots for a led, the LSB is played first
+     * - bits with the state of the led for each slot
+     * - number of slots in the sequence (max 32)
+     */
+    typedef struct led_pattern {
+        uint32_t bits;
+        uint8_t length;
+    } led_pattern_t;
+    /// Two short beats every second
+    extern const led_pattern_t LED_PATTERN_HEARTBEAT;
+    /// Morse SOS in two seconds
+    extern const led_pattern_t LED_PATTERN_SOS;
+
+    /// Status shown until it is cleared
+    #define LED_FOREVER 0
+    /// Number of status priorities for each led
+    #define LED_PRIORITY_LEVELS 4
+
+    /// Priority of a led status, the highest active status is shown
+    typedef enum {
+        LED_PRIORITY_BASE = 0,      ///< Default status, from LED_updateBlink
+        LED_PRIORITY_STATUS,        ///< Status of a module
+        LED_PRIORITY_EFFECT,        ///< Led effects
+        LED_PRIORITY_FAULT,         ///< Fault and diagnostic codes
+    } led_priority_t;
+
+    /**
+     * Status request on a led
+     * - compiled pattern
+     * - length of the pattern
+     * - number of blink or LED_PATTERN
+     * - pattern cycles left to show, LED_FOREVER never expire
+     * - if the status is requested
+     */
+    typedef struct led_status {
+        uint32_t bits;
+        uint8_t length;
+        short number_blink;
+        uint16_t cycles;
+        bool active;
+    } led_status_t;
 
     /**
      * Struct to control blink led
      * - port name to bit register to mount led
-     * - counter to control blink led
-     * - number of blink in a period, if:
+     * - compiled pattern to play
+     * - pattern in play, shifted every slot
+     * - length of the pattern
+     * - slots left before to reload the pattern
+     * - brightness of the led (0 - LED_BRIGHTNESS_MAX)
+     * - duty cycle of the PWM in Q8 from gamma table
+     * - brightness to reach with a fade
+     * - brightness step each PWM period in Q8, 0 without fade
+     * - fraction of brightness carried to the next PWM period in Q8
+     * - if the fade restart in the opposite direction (breathing)
+     * - status requested for each priority
+     * - priority of the status shown
+     * - number of blink shown in a period, if:
+     *      -# -2 custom pattern - LED_PATTERN
      *      -# -1 fixed led - LED_ALWAYS_HIGH
      *      -# 0 led off - LED_OFF
      *      -# n number of blink
      */
     typedef struct led_control {
         gpio_t gpio;
-        unsigned int counter;
-        unsigned int fr_blink;
-        unsigned int wait;
+        uint32_t pattern;
+        uint32_t shift;
+        uint8_t length;
+        uint8_t remaining;
+        uint8_t brightness;
+        uint8_t duty;
+        uint8_t target;
+        uint16_t step;
+        uint8_t fraction;
+        bool breath;
+        led_status_t status[LED_PRIORITY_LEVELS];
+        uint8_t show;
         short number_blink;
     } led_control_t;
 /******************************************************************************/
@@ -64,32 +142,90 @@ extern "C" {
      */
     hEvent_t LED_Init(uint16_t freq, led_control_t* led_controller, size_t len);
     /**
-     * Update frequency or type of blink
+     * Update frequency or type of blink of the default status
      * @param led array of available leds
      * @param num number led
-     * @param blink number of blinks
+     * @param blink number of blinks, up to LED_PATTERN_MAX_BLINK, LED_OFF or
+     * LED_ALWAYS_HIGH; other negative values are ignored
      */
     void LED_updateBlink(led_control_t *led, short num, short blink);
     /**
-     * Blink controller for leds. This function you must add in timer function
+     * Play a custom pattern on a led as default status
+     * @param led array of available leds
+     * @param num number led
+     * @param pattern sequence to play
+     */
+    void LED_updatePattern(led_control_t *led, short num, const led_pattern_t* pattern);
+    /**
+     * Request a blink code with a priority. The led shows the active status
+     * with the highest priority, when it expires or is cleared the lower
+     * status is restored.
+     * @param led array of available leds
+     * @param num number led
+     * @param blink number of blinks up to LED_PATTERN_MAX_BLINK, LED_OFF
+     * or LED_ALWAYS_HIGH; other negative values are ignored
+     * @param priority priority of the request, replace the previous one
+     * @param cycles number of cycles to show, LED_FOREVER until cleared
+     */
+    void LED_pushBlink(led_control_t *led, short num, short blink, led_priority_t priority, uint16_t cycles);
+    /**
+     * Request a custom pattern with a priority
+     * @param led array of available leds
+     * @param num number led
+     * @param pattern sequence to play
+     * @param priority priority of the request, replace the previous one
+     * @param cycles number of cycles to show, LED_FOREVER until cleared
+     */
+    void LED_pushPattern(led_control_t *led, short num, const led_pattern_t* pattern, led_priority_t priority, uint16_t cycles);
+    /**
+     * Remove the request with a priority and restore the lower status
+     * @param led array of available leds
+     * @param num number led
+     * @param priority priority to clear, LED_PRIORITY_BASE switch off the led
+     */
+    void LED_clearStatus(led_control_t *led, short num, led_priority_t priority);
+    /**
+     * Set the brightness of a led and stop fade or breathing effects
+     * @param led array of available leds
+     * @param num number led
+     * @param brightness new brightness (0 - LED_BRIGHTNESS_MAX)
+     */
+    void LED_setBrightness(led_control_t *led, short num, uint8_t brightness);
+    /**
+     * Fade the led from the current brightness to a new one
+     * @param led array of available leds
+     * @param num number led
+     * @param brightness brightness to reach
+     * @param time duration of the fade in [mS]
+     */
+    void LED_fade(led_control_t *led, short num, uint8_t brightness, uint16_t time);
+    /**
+     * Breathing effect, the led fades in and out until a new brightness is set
+     * @param led array of available leds
+     * @param num number led
+     * @param period time of a full breath in [mS]
+     */
+    void LED_breath(led_control_t *led, short num, uint16_t period);
+    /**
+     * Blink controller for leds. This function you must add in timer function.
+     * Every slot the consecutive leds on the same port are written with a
+     * single access, keep the leds of a port close in the array.
      * @param led to control
      * @param len number of registered led
      */
     inline void LED_blinkController(led_control_t *led, size_t len);
     /**
-     * Start led effect flush
+     * Start led effect flush, with LED_PRIORITY_EFFECT
      * @param led_controller list of all leds
-     * @param load_blink 
      * @param len number of registered led
      */
-    void LED_blinkFlush(led_control_t* led_controller, short* load_blink, size_t len);
+    void LED_blinkFlush(led_control_t* led_controller, size_t len);
     /**
-     * Stop all led effects
+     * Stop all led effects and restore the previous status
      * @param led_controller list of all leds
-     * @param load_blink
      * @param len number of registered led
      */
-    void LED_effectStop(led_control_t* led_controller, short* load_blink, size_t len);
+    void LED_effectStop(led_control_t* led_controller, size_t len);
 
 
 #ifdef	__cplusplus
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef CPU_LOAD_H
+#define	CPU_LOAD_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>        /* Includes uint16_t definition                    */
+#include <stdbool.h>       /* Includes true/false definition                  */
+
+#include "peripherals/gpio.h"
+#include "system/events.h"
+
+/******************************************************************************/
+/* System Level #define Macros                                                */
+/******************************************************************************/
+    /// Number of 1 s windows in the long window
+    #define CPU_LOAD_WINDOWS 10
+    /// Load of the full CPU, in hundredths of percent
+    #define CPU_LOAD_FULL 10000
+
+    /**
+     * Level of the CPU time: the event priorities, then the kernel tick
+     * and the idle time, outside of event_manager and task_manager
+     */
+    typedef enum {
+        CPU_LOAD_TICK = LNG_EVENTPRIORITY,
+        CPU_LOAD_IDLE,
+    } cpu_load_level_t;
+    /// Number of levels
+    #define LNG_CPU_LOAD (CPU_LOAD_IDLE + 1)
+    /// Time window of the load
+    typedef enum {
+        CPU_LOAD_1S = 0,
+        CPU_LOAD_10S,
+    } cpu_load_window_t;
+
+/******************************************************************************/
+/* System Function Prototypes                                                 */
+/******************************************************************************/
+    /**
+     * Start to measure the load. The time between two measures must be
+     * shorter than a timer period, so the timer interrupt must preempt
+     * the callbacks to count the long ones.
+     * @param timer_register timer of the kernel tick
+     * @param pr_timer period register of the timer
+     * @param frequency frequency of the kernel tick
+     */
+    void cpu_load_init(REGISTER timer_register, REGISTER pr_timer, frequency_t frequency);
+    /**
+     * Start a level, the time up to now goes to the level in progress.
+     * A level over the nesting of all levels, or out of the levels, is
+     * ignored with its exit and counted in cpu_load_overflows.
+     * @param level priority of the events, CPU_LOAD_TICK
+     */
+    inline void cpu_load_enter(unsigned int level);
+    /**
+     * Return to the level in progress before the last cpu_load_enter
+     */
+    inline void cpu_load_exit(void);
+    /**
+     * Close the 1 s window after a second of ticks, call from the tick
+     */
+    inline void cpu_load_tick(void);
+    /**
+     * Load of each level in the last complete window
+     * @param window 1 s or rolling 10 s
+     * @param load LNG_CPU_LOAD values in hundredths of percent
+     */
+    void cpu_load_get(cpu_load_window_t window, uint16_t* load);
+    /**
+     * Number of levels ignored over the nesting, the enter and exit calls
+     * are not in pairs
+     * @return levels ignored from cpu_load_init
+     */
+    uint16_t cpu_load_overflows(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* CPU_LOAD_H */
+
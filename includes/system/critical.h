@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+
+#ifndef CRITICAL_H
+#define	CRITICAL_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>        /* Includes uint16_t definition                    */
+#include <stdbool.h>       /* Includes true/false definition                  */
+
+#include "peripherals/gpio.h"
+
+/******************************************************************************/
+/* System Level #define Macros                                                */
+/******************************************************************************/
+    /// Ceiling of a section with all the maskable interrupts off
+    #define CRITICAL_ALL 7
+
+    /// Call site of a critical section, with the time of the longest run
+    typedef struct _critical_site {
+        const char* name;           ///< Function of the section
+        uint16_t line;              ///< Line of the section
+        bool linked;                ///< In the list of the sites
+        uint32_t count;             ///< Runs of the section
+        uint32_t max;               ///< Longest run, in timer counts
+        struct _critical_site* next; ///< Next site of the list
+    } critical_site_t;
+    /// Section in progress, on the stack of the caller
+    typedef struct _critical {
+        int save;                   ///< CPU priority before the section
+        unsigned int timer;         ///< Timer at the start
+        uint32_t ticks;             ///< Kernel ticks at the start
+        critical_site_t* site;      ///< Site of the section, NULL without measure
+    } critical_t;
+
+    /// Site of the section at the line of the macro
+    #define CRITICAL_SITE(site) static critical_site_t site = {__FUNCTION__, __LINE__, false, 0, 0, NULL}
+    /// Start a measured section, masked up to the ceiling
+    #define CRITICAL_ENTER(section, ceiling)                                \
+                do {                                                        \
+                    CRITICAL_SITE(critical_site);                           \
+                    critical_enter(&(section), &critical_site, (ceiling));  \
+                } while (0)
+    /// End the section
+    #define CRITICAL_EXIT(section) critical_exit(&(section))
+
+/******************************************************************************/
+/* System Function Prototypes                                                 */
+/******************************************************************************/
+    /**
+     * Start to measure the critical sections, the counters go to zero.
+     * The kernel ticks count the timer periods, a section over the tick
+     * interrupt is measured modulo a period.
+     * @param timer_register timer of the kernel tick, NULL to stop the measure
+     * @param pr_timer period register of the timer
+     */
+    void critical_init(REGISTER timer_register, REGISTER pr_timer);
+    /**
+     * Start a critical section. The CPU priority goes up to the ceiling and
+     * never down, so the sections nest and a section in an interrupt over
+     * the ceiling keeps its priority.
+     * @param section section in progress, for critical_exit
+     * @param site call site, NULL without measure
+     * @param ceiling max priority of the interrupts masked
+     */
+    inline void critical_enter(critical_t* section, critical_site_t* site, unsigned int ceiling);
+    /**
+     * End the critical section, the CPU priority goes back to the start
+     * of the section
+     * @param section section in progress
+     */
+    inline void critical_exit(critical_t* section);
+    /**
+     * List of the sites run at least once
+     * @return first site, NULL without sites
+     */
+    critical_site_t* critical_sites(void);
+    /**
+     * Reset the counters of all sites
+     */
+    void critical_reset_stats(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* CRITICAL_H */
+
@@ -43,12 +43,48 @@ extern "C" {
         EVENT_PRIORITY_HIGH,
         EVENT_PRIORITY_VERY_LOW,
     } eventPriority;
+    /// Number of software levels, up to 32
+    #ifndef EVENT_LEVELS
+    #define EVENT_LEVELS 16
+    #endif
+    /// Software levels on each hardware priority, from VERY_LOW to HIGH
+    #define EVENT_LEVELS_PRIORITY (EVENT_LEVELS / LNG_EVENTPRIORITY)
+    /// Invalid software level
+    #define INVALID_EVENT_LEVEL 0xFF
+    /// Event without budget
+    #define EVENT_NO_BUDGET 0
+
+    /// Action after a callback over its budget
+    typedef enum _event_overrun {
+        EVENT_OVERRUN_REPORT = 0,   ///< Count and report only
+        EVENT_OVERRUN_DEMOTE,       ///< Move the event on the lower hardware priority
+        EVENT_OVERRUN_SKIP,         ///< Drop the next triggers
+    } event_overrun_t;
     /// Definition of frequency
     typedef uint32_t frequency_t;
     /// event register number
     typedef uint16_t hEvent_t;
+    /// Argument of an event, large enough to hold a pointer
+    typedef intptr_t event_arg_t;
     /// Callback when the function start
-    typedef void (*event_callback_t)(int argc, int* argv);
+    typedef void (*event_callback_t)(int argc, event_arg_t* argv);
+    /// Counters of an event
+    typedef struct _event_stats {
+        uint32_t triggers;          ///< Triggers accepted
+        uint32_t runs;              ///< Callbacks completed
+        uint16_t overruns;          ///< Callbacks over the budget
+        uint64_t time;              ///< Time of all callbacks in [nS]
+    } event_stats_t;
+    /// Report of a callback over its budget, with the time of the callback in [uS] as the budget
+    typedef void (*event_overrun_hook_t)(hEvent_t hEvent, uint32_t time);
+    /// Instant on the timer of the kernel, for intervals shorter than a tick
+    typedef struct _event_stamp {
+        uint32_t ticks;             ///< Ticks of the task manager
+        unsigned int counts;        ///< Counts of the timer in the tick
+    } event_stamp_t;
+    /// Snapshot in progress, in system/snapshot.h
+    struct _snapshot;
+
 /******************************************************************************/
 /* System Function Prototypes                                                 */
 /******************************************************************************/
@@ -77,7 +113,7 @@ extern "C" {
      * @param argc number of data
      * @param argv datas
      */
-    void trigger_event_data(hEvent_t hEvent, int argc, int *argv);
+    void trigger_event_data(hEvent_t hEvent, int argc, event_arg_t *argv);
     /**
      * Register an event with a function to call when the event started.
      * Default priority values is EVENT_PRIORITY_MEDIUM
@@ -94,12 +130,80 @@ extern "C" {
      * @return number event
      */
     hEvent_t register_event_p(hModule_t name, event_callback_t event_callback, eventPriority priority);
+    /**
+     * Register an event with a software level. The levels go on the hardware
+     * priorities in groups of EVENT_LEVELS_PRIORITY, from VERY_LOW to HIGH;
+     * without the interrupt of the group the event goes on the nearest
+     * lower priority registered, else on the nearest higher.
+     * On the same priority the callback with the highest level pending runs
+     * first, with the same level the first registered.
+     * register_event_p uses the lowest level of the priority.
+     * @param name associated number module name
+     * @param event_callback function to call
+     * @param level software level, from 0 to EVENT_LEVELS - 1
+     * @return number event
+     */
+    hEvent_t register_event_level(hModule_t name, event_callback_t event_callback, uint8_t level);
+    /**
+     * Software level of the event
+     * @param hEvent number event
+     * @return level, INVALID_EVENT_LEVEL for a wrong event
+     */
+    uint8_t get_event_level(hEvent_t hEvent);
+    /**
+     * Set the execution budget of the event. The time of the callback is
+     * the time between start and end, with the interrupts in the middle.
+     * A demoted event goes EVENT_LEVELS_PRIORITY levels down and stays
+     * there up to the next call of this function.
+     * @param hEvent number event
+     * @param budget max time of the callback in [uS], EVENT_NO_BUDGET to disable
+     * @param action action after an overrun
+     * @param skip triggers dropped after an overrun, with EVENT_OVERRUN_SKIP
+     * @return false for a wrong event
+     */
+    bool event_set_budget(hEvent_t hEvent, uint32_t budget, event_overrun_t action, uint8_t skip);
+    /**
+     * Register the function called after each overrun, from event_manager
+     * @param hook function to call, NULL to remove it
+     */
+    void event_overrun_hook(event_overrun_hook_t hook);
+    /**
+     * Number of callbacks over the budget
+     * @param hEvent number event
+     * @return overruns from the last event_set_budget
+     */
+    uint16_t get_event_overruns(hEvent_t hEvent);
     /**
      * Get number module associated
      * @param eventIndex index event
      * @return index module
      */
     hModule_t get_event_name(hEvent_t eventIndex);
+    /**
+     * Find the events of a module
+     * @param module number module
+     * @param from first event to check, 0 at the start
+     * @return first event of the module from this one, INVALID_EVENT_HANDLE
+     * at the end
+     */
+    hEvent_t event_next(hModule_t module, hEvent_t from);
+    /**
+     * Counters of the event from the registration
+     * @param hEvent number event
+     * @param stats destination of the counters
+     * @return false for a wrong event
+     */
+    bool get_event_stats(hEvent_t hEvent, event_stats_t* stats);
+    /**
+     * Write the section of the registered events
+     * @param snapshot snapshot in progress
+     */
+    void event_snapshot(struct _snapshot* snapshot);
+    /**
+     * Check if some event waits for its callback
+     * @return true if an event is triggered and not started
+     */
+    bool event_pending(void);
     /**
      * Remove from list of events the event
      * @param eventIndex index event
@@ -117,6 +221,24 @@ extern "C" {
      * @return time to computation in [nS]
      */
     inline uint32_t get_time(hEvent_t hEvent);
+    /**
+     * Take the instant on the timer of init_events and on the ticks
+     * @param stamp destination of the instant
+     */
+    inline void event_stamp(event_stamp_t* stamp);
+    /**
+     * Time from an instant. A tick waiting for its interrupt counts a
+     * period of the timer short, the result is corrected.
+     * @param stamp instant from event_stamp
+     * @return timer counts from the instant, UINT32_MAX if longer
+     */
+    inline uint32_t event_elapsed(const event_stamp_t* stamp);
+    /**
+     * Convert counts of the timer
+     * @param counts timer counts
+     * @return time in [uS]
+     */
+    uint32_t event_counts_us(uint32_t counts);
 
 #ifdef	__cplusplus
 }
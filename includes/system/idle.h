@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef IDLE_H
+#define	IDLE_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>        /* Includes uint16_t definition                    */
+#include <stdbool.h>       /* Includes true/false definition                  */
+
+#include "peripherals/gpio.h"
+
+/******************************************************************************/
+/* System Level #define Macros                                                */
+/******************************************************************************/
+
+    /// Counters of the power save
+    typedef struct _idle_stats {
+        uint32_t calls;             ///< Calls of idle_manager
+        uint32_t busy;              ///< Calls with events waiting
+        uint32_t wakeups;           ///< Power saves ended from an interrupt
+        uint32_t sleeps;            ///< Power saves in sleep
+        uint32_t residency;         ///< Timer periods in idle
+        uint16_t residency_counts;  ///< Timer counts in idle, over the periods
+    } idle_stats_t;
+
+/******************************************************************************/
+/* System Function Prototypes                                                 */
+/******************************************************************************/
+    /**
+     * Initialize the power save of the main loop
+     * @param timer_register timer of the kernel tick
+     * @param pr_timer period register of the timer
+     * @param sleep true to sleep without running tasks, the timer stops
+     * and an external interrupt must wake the CPU
+     */
+    void idle_init(REGISTER timer_register, REGISTER pr_timer, bool sleep);
+    /**
+     * Call in the main loop. Without events waiting the CPU goes in idle
+     * up to the next interrupt, the kernel tick at last; without running
+     * tasks it can sleep. An event triggered during the check wakes the
+     * CPU at once.
+     * @return false if there are events waiting
+     */
+    bool idle_manager(void);
+    /**
+     * Copy the counters of the power save
+     * @param stats destination of the counters
+     */
+    void idle_get_stats(idle_stats_t* stats);
+    /**
+     * Reset the counters of the power save
+     */
+    void idle_reset_stats(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* IDLE_H */
+
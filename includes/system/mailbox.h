@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+
+#ifndef MAILBOX_H
+#define	MAILBOX_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>        /* Includes uint16_t definition                    */
+#include <stdbool.h>       /* Includes true/false definition                  */
+#include <stddef.h>
+
+#include "system/events.h"
+#include "system/modules.h"
+
+/******************************************************************************/
+/* System Level #define Macros                                                */
+/******************************************************************************/
+    /**
+     * Callback of a mailbox, once for each message in the order of the posts
+     * @param hEvent event of the mailbox
+     * @param message message, valid up to the return
+     */
+    typedef void (*mailbox_callback_t)(hEvent_t hEvent, const void* message);
+    /// Mailbox of an event, a ring of slots of a message each
+    typedef struct _mailbox {
+        uint8_t* slots;             ///< Storage of depth * size bytes
+        size_t size;                ///< Size of a message
+        uint8_t depth;              ///< Number of slots
+        volatile uint8_t head;      ///< First message
+        volatile uint8_t count;     ///< Messages waiting
+        uint16_t lost;              ///< Posts with the mailbox full
+        hEvent_t event;             ///< Event of the mailbox
+        event_arg_t arg;            ///< Argument of the event, the mailbox itself
+        mailbox_callback_t callback; ///< Function to call
+    } mailbox_t;
+
+    /// Max number of slots of a mailbox
+    #define MAILBOX_MAX_DEPTH 255
+    /// Storage of a mailbox for depth messages of a type
+    #define MAILBOX_SLOTS(name, type, depth) type name[depth]
+    /// Number of slots of a storage, a storage over MAILBOX_MAX_DEPTH does not compile
+    #define MAILBOX_DEPTH(slots) (sizeof(slots) / sizeof((slots)[0]) \
+                + 0 * sizeof(char[(sizeof(slots) / sizeof((slots)[0]) <= MAILBOX_MAX_DEPTH) ? 1 : -1]))
+    /**
+     * Initialize a mailbox on the storage of MAILBOX_SLOTS. The macros check
+     * only the sizes: the callback still receives a const void* and casts
+     * it to the type of the slots.
+     */
+    #define MAILBOX_INIT(box, slots, module, callback, priority) \
+                mailbox_init(&(box), (slots), sizeof((slots)[0]), MAILBOX_DEPTH(slots), \
+                            (module), (callback), (priority))
+    /// Post a message of the size of the slots
+    #define MAILBOX_POST(box, message) mailbox_post(&(box), &(message), sizeof(message))
+
+/******************************************************************************/
+/* System Function Prototypes                                                 */
+/******************************************************************************/
+    /**
+     * Initialize the mailbox and register its event
+     * @param box mailbox
+     * @param slots storage of depth * size bytes
+     * @param size size of a message
+     * @param depth number of messages, up to MAILBOX_MAX_DEPTH
+     * @param module associated number module name
+     * @param callback function to call for each message
+     * @param priority priority of the event
+     * @return number event, INVALID_EVENT_HANDLE if not registered
+     */
+    hEvent_t mailbox_init(mailbox_t* box, void* slots, size_t size, uint8_t depth,
+            hModule_t module, mailbox_callback_t callback, eventPriority priority);
+    /**
+     * Copy the message in the mailbox and trigger its event, also from an
+     * interrupt. The copy runs with the interrupts masked, the messages
+     * should be small.
+     * @param box mailbox
+     * @param message message to copy
+     * @param size size of the message, the size of the slots
+     * @return false with the mailbox full or a wrong size
+     */
+    bool mailbox_post(mailbox_t* box, const void* message, size_t size);
+    /**
+     * Number of messages waiting
+     * @param box mailbox
+     * @return messages not yet processed
+     */
+    uint8_t mailbox_count(mailbox_t* box);
+    /**
+     * Number of posts lost with the mailbox full
+     * @param box mailbox
+     * @return posts lost from the initialization
+     */
+    uint16_t mailbox_lost(mailbox_t* box);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* MAILBOX_H */
+
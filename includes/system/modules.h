@@ -27,19 +27,79 @@ extern "C" {
 /******************************************************************************/
     
 #include <stdint.h>        /* Includes uint16_t definition                    */
+#include <stdbool.h>       /* Includes true/false definition                  */
 #include "data/data.h"
     
     /// Invalid handle for event
     #define INVALID_MODULE_HANDLE 0xFFFF
 
+    /// Max number of modules
+    #ifndef MAX_MODULES
+    #define MAX_MODULES 16
+    #endif
+    /// Slots of the hash table of the names (power of two, over MAX_MODULES)
+    #ifndef MODULE_TABLE_SIZE
+    #define MODULE_TABLE_SIZE 32
+    #endif
+
     /// Module register number
     typedef uint16_t hModule_t;
+    /// Resources and counters of all events and tasks of a module
+    typedef struct _module_stats {
+        unsigned short events;      ///< Events registered, tasks included
+        unsigned short tasks;       ///< Tasks loaded
+        uint32_t triggers;          ///< Triggers of the events
+        uint32_t runs;              ///< Callbacks completed
+        uint32_t overruns;          ///< Callbacks over the budget
+        uint64_t time;              ///< Time of all callbacks in [nS]
+    } module_stats_t;
     
+    /// Snapshot in progress, in system/snapshot.h
+    struct _snapshot;
+
 /******************************************************************************/
 /* System Function Prototypes                                                 */
 /******************************************************************************/
-
-hModule_t register_module(string_data_t* name);
+    /**
+     * Remove all modules
+     */
+    void init_modules(void);
+    /**
+     * Register a module. The name is kept, not copied: a name registered
+     * again returns the same module.
+     * @param name name of the module
+     * @return number module, INVALID_MODULE_HANDLE without free modules
+     */
+    hModule_t register_module(string_data_t* name);
+    /**
+     * Find a module from its name
+     * @param name name of the module
+     * @return number module, INVALID_MODULE_HANDLE if not registered
+     */
+    hModule_t module_find(const char* name);
+    /**
+     * Name of the module
+     * @param module number module
+     * @return name, NULL for a wrong module
+     */
+    const string_data_t* module_get_name(hModule_t module);
+    /**
+     * Number of registered modules, the modules go from 0 to this number - 1
+     * @return number of modules
+     */
+    unsigned short get_module_number(void);
+    /**
+     * Sum the counters of the events and tasks of the module
+     * @param module number module
+     * @param stats destination of the counters
+     * @return false for a wrong module
+     */
+    bool module_get_stats(hModule_t module, module_stats_t* stats);
+    /**
+     * Write the section of the modules
+     * @param snapshot snapshot in progress
+     */
+    void module_snapshot(struct _snapshot* snapshot);
 
 
 
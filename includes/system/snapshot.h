@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+
+#ifndef SNAPSHOT_H
+#define	SNAPSHOT_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>        /* Includes uint16_t definition                    */
+#include <stdbool.h>       /* Includes true/false definition                  */
+#include <stddef.h>
+
+/******************************************************************************/
+/* System Level #define Macros                                                */
+/******************************************************************************/
+    /// First word of a snapshot, "KS" in little endian
+    #define SNAPSHOT_MAGIC 0x534B
+    /// Version of the snapshot format
+    #define SNAPSHOT_VERSION 1
+    /// Size of the header
+    #define SNAPSHOT_HEADER_SIZE 12
+    /// Size of the header of a section
+    #define SNAPSHOT_SECTION_SIZE 4
+    /// Max number of sources after the kernel sections
+    #ifndef SNAPSHOT_SOURCES
+    #define SNAPSHOT_SOURCES 4
+    #endif
+    /// Characters of a module name in the snapshot, the rest is cut
+    #define SNAPSHOT_NAME_SIZE 12
+
+    /**
+     * Type of a section. A section is type, record size and number of
+     * records, a decoder skips the types it does not know.
+     */
+    typedef enum {
+        SNAPSHOT_EVENTS = 1,        ///< A record for each registered event
+        SNAPSHOT_TASKS,             ///< A record for each loaded task
+        SNAPSHOT_MODULES,           ///< A record for each module
+        SNAPSHOT_I2C,               ///< A record for an I2C bus, with the queues of each priority
+        SNAPSHOT_GPIO,              ///< A record for each pin of a GPIO port
+    } snapshot_type_t;
+    /// Size of the records of each section, little endian without padding
+    #define SNAPSHOT_EVENT_SIZE 26
+    #define SNAPSHOT_TASK_SIZE 14
+    #define SNAPSHOT_MODULE_SIZE (4 + SNAPSHOT_NAME_SIZE)
+    #define SNAPSHOT_GPIO_SIZE 8
+
+    /// Snapshot in progress on the buffer of the caller
+    typedef struct _snapshot {
+        uint8_t* data;              ///< Buffer
+        size_t size;                ///< Size of the buffer
+        size_t length;              ///< Bytes written
+        uint8_t sections;           ///< Sections written
+        bool full;                  ///< Buffer too small
+    } snapshot_t;
+    /**
+     * Source of a section, called from snapshot_take
+     * @param snapshot snapshot in progress
+     * @param context context of the source
+     */
+    typedef void (*snapshot_source_t)(snapshot_t* snapshot, void* context);
+
+/******************************************************************************/
+/* System Function Prototypes                                                 */
+/******************************************************************************/
+    /**
+     * Add a source after the sections of the kernel, as I2C_snapshot with
+     * its bus
+     * @param source function to call
+     * @param context context of the source
+     * @return false without free sources
+     */
+    bool snapshot_register(snapshot_source_t source, void* context);
+    /**
+     * Write the header, events, tasks, modules, GPIO and the sources in the
+     * buffer. Each record is read with the interrupts masked, the records
+     * are not taken at the same instant: a record removed meanwhile is
+     * padded, the count of a section is always right.
+     * @param buffer destination
+     * @param size size of the buffer
+     * @return size of the snapshot, 0 if the buffer is too small
+     */
+    size_t snapshot_take(uint8_t* buffer, size_t size);
+    /**
+     * Start a section
+     * @param snapshot snapshot in progress
+     * @param type type of the section
+     * @param record_size size of a record
+     * @param count number of records following
+     */
+    void snapshot_section(snapshot_t* snapshot, snapshot_type_t type, uint8_t record_size, uint16_t count);
+    /**
+     * Write a value in little endian
+     * @param snapshot snapshot in progress
+     * @param value value to write
+     */
+    void snapshot_put8(snapshot_t* snapshot, uint8_t value);
+    void snapshot_put16(snapshot_t* snapshot, uint16_t value);
+    void snapshot_put32(snapshot_t* snapshot, uint32_t value);
+    /**
+     * Fill the records missing from the count of the section, for the
+     * tables changed while they are written. The bytes of a padded record
+     * are 0xFF, the index in the first word is an invalid handle.
+     * @param snapshot snapshot in progress
+     * @param record_size size of a record
+     * @param count number of records to fill
+     */
+    void snapshot_pad(snapshot_t* snapshot, uint8_t record_size, uint16_t count);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* SNAPSHOT_H */
+
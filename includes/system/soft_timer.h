@@ -59,7 +59,7 @@ extern "C" {
      * @param timer the timer
      * @return return true if is in time
      */
-    bool __attribute__((always_inline)) run_timer(soft_timer_t *timer);
+    inline bool run_timer(soft_timer_t *timer);
     
 #ifdef	__cplusplus
 }
@@ -33,11 +33,11 @@ extern "C" {
     #define INVALID_TASK_HANDLE 0xFFFF
     /// Invalid handle for event
     #define INVALID_FREQUENCY 0xFFFFFFFF
+    /// No running tasks to release
+    #define TASK_NO_RELEASE 0xFFFF
 
     /// Definition of Task
     typedef uint16_t hTask_t;
-    /// time function in [uS]
-    typedef int16_t time_t;
     /**
      * Definition status task:
      * STOP - The task is loaded, but does not work
@@ -56,6 +56,9 @@ extern "C" {
         hTask_t task;
         frequency_t frequency;
     } task_t;
+    /// Snapshot in progress, in system/snapshot.h
+    struct _snapshot;
+
 /******************************************************************************/
 /* System Function Prototypes                                                 */
 /******************************************************************************/
@@ -72,11 +75,14 @@ extern "C" {
      */
     hTask_t task_load(hEvent_t hEvent, frequency_t frequency);
     /**
-     * Load event in task manager, with a frequency and arguments to lanch when started
+     * Load event in task manager, with a frequency and arguments to lanch when started.
+     * The arguments are read as event_arg_t, wide as a pointer: cast each
+     * one, (event_arg_t) value, an int without cast is undefined where a
+     * pointer is wider than an int.
      * @param hEvent number event
      * @param frequency frequency to automatic start
      * @param argc number arguments
-     * @param argv arguments
+     * @param argv arguments, each one cast to event_arg_t
      * @return number task
      */
     hTask_t task_load_data(hEvent_t hEvent, frequency_t frequency, int argc, ...);
@@ -106,11 +112,35 @@ extern "C" {
      * @return number module
      */
     hModule_t task_get_name(hTask_t taskIndex);
+    /**
+     * Find the tasks of a module
+     * @param module number module
+     * @param from first task to check, 0 at the start
+     * @return first task of the module from this one, INVALID_TASK_HANDLE
+     * at the end
+     */
+    hTask_t task_next(hModule_t module, hTask_t from);
+    /**
+     * Write the section of the loaded tasks
+     * @param snapshot snapshot in progress
+     */
+    void task_snapshot(struct _snapshot* snapshot);
     /**
      * Number of registered tasks
      * @return number task
      */
     unsigned short get_task_number(void);
+    /**
+     * Number of task manager calls from the initialization, the time base
+     * of the kernel at timer frequency
+     * @return number of ticks
+     */
+    uint32_t task_get_ticks(void);
+    /**
+     * Ticks before the next release of a running task
+     * @return number of ticks, TASK_NO_RELEASE without running tasks
+     */
+    uint16_t task_next_release(void);
     /**
      *  This function you must call in timer function
      */
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+
+#ifndef TOPIC_H
+#define	TOPIC_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>        /* Includes uint16_t definition                    */
+#include <stdbool.h>       /* Includes true/false definition                  */
+#include <stddef.h>
+
+#include "system/events.h"
+#include "system/modules.h"
+
+/******************************************************************************/
+/* System Level #define Macros                                                */
+/******************************************************************************/
+    /// Number of topics
+    #ifndef TOPIC_MAX
+    #define TOPIC_MAX 8
+    #endif
+    /// Number of subscriptions of all topics
+    #ifndef TOPIC_SUBSCRIPTIONS
+    #define TOPIC_SUBSCRIPTIONS 16
+    #endif
+    /// Number of message buffers shared by all topics
+    #ifndef TOPIC_BUFFERS
+    #define TOPIC_BUFFERS 8
+    #endif
+    /// Size of a message buffer in bytes
+    #ifndef TOPIC_BUFFER_SIZE
+    #define TOPIC_BUFFER_SIZE 32
+    #endif
+    /// Invalid handle for topic
+    #define INVALID_TOPIC_HANDLE 0xFFFF
+
+    /// Topic register number
+    typedef uint16_t hTopic_t;
+    /**
+     * Callback of a subscription, the message is valid up to the return
+     * @param topic topic of the message
+     * @param data message, shared with the other subscribers
+     * @param size size of the message in bytes
+     */
+    typedef void (*topic_callback_t)(hTopic_t topic, const void* data, size_t size);
+    /// Counters of a topic
+    typedef struct _topic_stats {
+        uint32_t published;         ///< Messages published
+        uint32_t dropped;           ///< Messages replaced before the callback
+    } topic_stats_t;
+
+/******************************************************************************/
+/* System Function Prototypes                                                 */
+/******************************************************************************/
+    /**
+     * Initialize topics, subscriptions and buffers
+     */
+    void topic_init(void);
+    /**
+     * Register a topic
+     * @param owner module publishing on the topic
+     * @return number topic, INVALID_TOPIC_HANDLE without free topics
+     */
+    hTopic_t topic_register(hModule_t owner);
+    /**
+     * Register an event of the module called with each message of the topic.
+     * A subscriber keeps only the last message: a new message before the
+     * callback replaces the previous one.
+     * @param topic number topic
+     * @param module module of the subscriber
+     * @param callback function to call with the message
+     * @param priority priority of the event
+     * @return number event of the subscription
+     */
+    hEvent_t topic_subscribe(hTopic_t topic, hModule_t module, topic_callback_t callback, eventPriority priority);
+    /**
+     * Take a free message buffer of TOPIC_BUFFER_SIZE bytes
+     * @return buffer, NULL without free buffers
+     */
+    void* topic_alloc(void);
+    /**
+     * Give back a buffer not published
+     * @param data buffer from topic_alloc
+     */
+    void topic_free(void* data);
+    /**
+     * Publish the buffer on the topic, without copy: every subscriber gets
+     * the same buffer, free again after the last callback. The buffer
+     * belongs to the kernel after the call.
+     * @param topic number topic
+     * @param data buffer from topic_alloc
+     * @param size size of the message in bytes
+     * @return false for a wrong topic, buffer or size, the buffer stays
+     * to the caller
+     */
+    bool topic_publish(hTopic_t topic, void* data, size_t size);
+    /**
+     * Counters of the topic
+     * @param topic number topic
+     * @param stats destination of the counters
+     * @return false for a wrong topic
+     */
+    bool topic_get_stats(hTopic_t topic, topic_stats_t* stats);
+    /**
+     * Number of free message buffers
+     * @return buffers not in use
+     */
+    unsigned short topic_free_buffers(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* TOPIC_H */
+
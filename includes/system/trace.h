@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef TRACE_H
+#define	TRACE_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>        /* Includes uint16_t definition                    */
+#include <stdbool.h>       /* Includes true/false definition                  */
+#include <stddef.h>
+
+#include "peripherals/gpio.h"
+#include "system/events.h"
+
+/******************************************************************************/
+/* System Level #define Macros                                                */
+/******************************************************************************/
+    /// Number of records in the ring (power of two)
+    #ifndef TRACE_SIZE
+    #define TRACE_SIZE 128
+    #endif
+    #if TRACE_SIZE < 1 || (TRACE_SIZE & (TRACE_SIZE - 1)) != 0
+    #error "TRACE_SIZE must be a power of two, the ring is indexed with a mask"
+    #endif
+    /// First word of a dump, "TR" in little endian
+    #define TRACE_MAGIC 0x5254
+    /// Version of the dump format
+    #define TRACE_VERSION 1
+    /// State of the bus not in the table of the I2C controller
+    #define TRACE_I2C_UNKNOWN 0xFF
+
+    /// Type of a record
+    typedef enum {
+        TRACE_TRIGGER = 1,          ///< Event triggered, id event, arg priority
+        TRACE_START,                ///< Callback started, id event, arg priority
+        TRACE_END,                  ///< Callback ended, id event, arg priority
+        TRACE_RELEASE,              ///< Task released, id task
+        TRACE_I2C_STATE,            ///< New state of a bus, id bus, arg state
+    } trace_type_t;
+    /**
+     * Record of the trace, 8 bytes. The time is the kernel tick and the
+     * timer register inside the tick.
+     */
+    typedef struct _trace_record {
+        uint16_t tick;              ///< Low word of the kernel ticks
+        uint16_t timer;             ///< Timer register
+        uint8_t type;               ///< trace_type_t
+        uint8_t arg;                ///< Priority or state
+        uint16_t id;                ///< Event, task or bus
+    } trace_record_t;
+    /**
+     * Header of a dump, followed from the ring of records. The oldest
+     * record is at head when the ring is full.
+     */
+    typedef struct _trace_header {
+        uint16_t magic;             ///< TRACE_MAGIC
+        uint8_t version;            ///< TRACE_VERSION
+        uint8_t record_size;        ///< Size of a record
+        uint16_t size;              ///< Records in the ring
+        uint16_t head;              ///< Next record to write
+        uint32_t count;             ///< Records written from the init
+        uint32_t frequency;         ///< Kernel ticks each second
+        uint16_t period;            ///< Timer counts each tick
+        uint16_t reserved;
+    } trace_header_t;
+
+/******************************************************************************/
+/* System Function Prototypes                                                 */
+/******************************************************************************/
+#ifdef KERNEL_TRACE
+    /// Record on the trace
+    #define TRACE(type, arg, id) trace_record((type), (arg), (id))
+    /**
+     * Initialize an empty trace and start to record
+     * @param timer_register timer of the kernel tick
+     * @param pr_timer period register of the timer
+     * @param frequency frequency of the kernel tick
+     */
+    void trace_init(REGISTER timer_register, REGISTER pr_timer, frequency_t frequency);
+    /**
+     * Start or freeze the recording, freeze the trace before a dump
+     * @param enable true to record
+     */
+    void trace_enable(bool enable);
+    /**
+     * Add a record, the oldest one is overwritten when the ring is full
+     * @param type type of record
+     * @param arg priority or state
+     * @param id event, task or bus
+     */
+    inline void trace_record(trace_type_t type, uint8_t arg, uint16_t id);
+    /**
+     * Header and ring in a single block, to send or save
+     * @param data start of the block
+     * @return size of the block in bytes
+     */
+    size_t trace_dump(const void** data);
+#else
+    #define TRACE(type, arg, id)
+    #define trace_init(timer_register, pr_timer, frequency)
+    #define trace_enable(enable)
+    #define trace_dump(data) 0
+#endif
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* TRACE_H */
+
@@ -20,6 +20,7 @@
 /******************************************************************************/
 
 #include "peripherals/gpio.h"
+#include "system/snapshot.h"
 
 /******************************************************************************/
 /* Global Variable Declaration                                                */
@@ -30,6 +31,7 @@ hardware_bit_t* ANA_ON;
 hardware_bit_t* DMA_ON;
 //gp_peripheral_t* GPIO_PORTS;
 gp_port_def_t* GPIO_PORTS[10];
+unsigned short GPIO_PORTS_LEN = 0;
 size_t LEN;
 gpio_adc_callbackFunc_t gpio_callback;
 int *indirect_reference[10];
@@ -51,6 +53,7 @@ bool gpio_init(hardware_bit_t* analog_on, hardware_bit_t* dma_on, REGISTER analo
     va_start(argp, argc);
     for(counter_port = 0; counter_port < argc; ++counter_port) {
         GPIO_PORTS[counter_port] = va_arg(argp, gp_port_def_t*);
+        GPIO_PORTS_LEN = counter_port + 1;
         for(i = 0; i < GPIO_PORTS[counter_port]->len; ++i) {
             state &= gpio_register_peripheral(&GPIO_PORTS[counter_port]->gpio[i]);
         }
@@ -178,6 +181,28 @@ void gpio_set(gpio_name_t name, gpio_port_t port) {
     }
 }
 
+void gpio_snapshot(snapshot_t* snapshot) {
+    gp_peripheral_t* pin;
+    unsigned short port, i;
+    uint16_t count = 0;
+    for (port = 0; port < GPIO_PORTS_LEN; ++port) {
+        count += GPIO_PORTS[port]->len;
+    }
+    snapshot_section(snapshot, SNAPSHOT_GPIO, SNAPSHOT_GPIO_SIZE, count);
+    for (port = 0; port < GPIO_PORTS_LEN; ++port) {
+        for (i = 0; i < GPIO_PORTS[port]->len; ++i) {
+            pin = &GPIO_PORTS[port]->gpio[i];
+            snapshot_put8(snapshot, port);
+            snapshot_put8(snapshot, i);
+            snapshot_put8(snapshot, pin->gpio.type);
+            snapshot_put8(snapshot, REGISTER_MASK_READ(pin->gpio.CS_TRIS, pin->gpio.CS_mask));
+            snapshot_put8(snapshot, REGISTER_MASK_READ(pin->gpio.CS_LAT, pin->gpio.CS_mask));
+            snapshot_put8(snapshot, REGISTER_MASK_READ(pin->gpio.CS_PORT, pin->gpio.CS_mask));
+            snapshot_put16(snapshot, (pin->common.analog != GPIO_NO_PERIPHERAL) ? pin->common.analog->number : 0xFFFF);
+        }
+    }
+}
+
 inline void gpio_ProcessADCSamples(short idx, int value) {
     *(indirect_reference[idx]) = value;
 }
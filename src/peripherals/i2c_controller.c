@@ -23,9 +23,14 @@
 /******************************************************************************/
 
 #include <stdbool.h>       /* Includes true/false definition */
+#include <string.h>
 
 #include "peripherals/i2c_controller.h"
 #include "system/modules.h"
+#include "system/critical.h"
+#include "system/task_manager.h"
+#include "system/trace.h"
+#include "system/snapshot.h"
 
 /// Define mask type of bit
 #define MASK_I2CCON_EN           BIT_MASK(15)
@@ -33,235 +38,511 @@
 #define MASK_I2CCON_ACKEN        BIT_MASK(4)
 #define MASK_I2CCON_RCEN         BIT_MASK(3)
 #define MASK_I2CCON_PEN          BIT_MASK(2)
+#define MASK_I2CCON_RSEN         BIT_MASK(1)
 #define MASK_I2CCON_SEN          BIT_MASK(0)
 
 #define MASK_I2CSTAT_ACKSTAT     BIT_MASK(15)
+#define MASK_I2CSTAT_BCL         BIT_MASK(10)
 
-#define I2C_COMMAND_WRITE 0
-#define I2C_COMMAND_READ 1
+#if (I2C_QUEUE_DEPTH & (I2C_QUEUE_DEPTH - 1)) != 0 || I2C_QUEUE_DEPTH > 128
+#error "I2C_QUEUE_DEPTH must be a power of two, max 128"
+#endif
+#if (I2C_QUEUE_HIGH_DEPTH & (I2C_QUEUE_HIGH_DEPTH - 1)) != 0 || I2C_QUEUE_HIGH_DEPTH > 128
+#error "I2C_QUEUE_HIGH_DEPTH must be a power of two, max 128"
+#endif
+
+/// Ceiling of the queues: the I2C interrupt and the priorities that submit messages
+#ifndef I2C_IPL
+#define I2C_IPL 7
+#endif
+
+/// The segment continues the previous one in the same phase of the bus
+#define I2C_SEGMENT_CONTINUE(seg) (((seg)->flags & I2C_SEGMENT_RESTART) == 0       \
+            && ((seg)->flags & I2C_SEGMENT_READ) == (((seg) - 1)->flags & I2C_SEGMENT_READ) \
+            && (seg)->command == ((seg) - 1)->command)
 
 /******************************************************************************/
 /* Global Variable Declaration                                                */
 /******************************************************************************/
 
-void I2C_load(void);
-void I2C_reset(void);
-void I2C_serve_queue(void);
-inline bool I2C_CheckAvailable(void);
-void I2C_startWrite(void);
-void I2C_writeCommand(void);
-void I2C_writeCommandData(void);
+void I2C_load(i2c_bus_t* bus);
+void I2C_account(i2c_bus_t* bus, bool state);
+void I2C_startTransaction(i2c_bus_t* bus);
+void I2C_serve_queue(i2c_bus_t* bus);
+inline bool I2C_CheckAvailable(i2c_bus_t* bus);
+void I2C_startWrite(i2c_bus_t* bus);
+void I2C_restart(i2c_bus_t* bus);
+void I2C_writeCommand(i2c_bus_t* bus);
 
 /* READ FUNCTIONS */
-void I2C_readStart(void);
-void I2C_readCommand(void);
-void I2C_recen(void);
-void I2C_recstore(void);
-void I2C_stopRead(void);
-void I2C_rerecen(void);
-void I2C_doneRead(void);
+void I2C_recen(i2c_bus_t* bus);
+void I2C_recstore(i2c_bus_t* bus);
+void I2C_stopRead(i2c_bus_t* bus);
+void I2C_rerecen(i2c_bus_t* bus);
 
 /* WRITE FUNCTIONS */
-void I2C_writeData(void);   
-void I2C_writeStop(void);
-void I2C_doneWrite(void);
+void I2C_writeData(i2c_bus_t* bus);   
+void I2C_writeStop(i2c_bus_t* bus);
 
 /* SERVICE FUNCTIONS */
-void I2C_idle(void);
-void I2C_Failed(void);
-bool I2C_Normal(void);
-void I2C_trigger_service(void);
+void I2C_done(i2c_bus_t* bus);
+void I2C_doneFailed(i2c_bus_t* bus);
+void I2C_idle(i2c_bus_t* bus);
+void I2C_Failed(i2c_bus_t* bus);
+bool I2C_Normal(i2c_bus_t* bus);
+void I2C_trigger_service(i2c_bus_t* bus);
+void I2C_fail(i2c_message_t* message);
+
+/// States of the bus on trace and snapshot, same order of the names in the host decoders
+static const i2c_state_func_t I2C_states[] = {
+    &I2C_idle, &I2C_startWrite, &I2C_restart, &I2C_writeCommand,
+    &I2C_recen, &I2C_recstore, &I2C_stopRead, &I2C_rerecen,
+    &I2C_writeData, &I2C_writeStop, &I2C_done, &I2C_doneFailed, &I2C_Failed,
+};
+/**
+ * Number of the state of the bus
+ * @param bus context of the bus
+ * @return position in I2C_states, TRACE_I2C_UNKNOWN if not there
+ */
+static uint8_t I2C_stateNumber(i2c_bus_t* bus) {
+    uint8_t state;
+    for (state = 0; state < sizeof(I2C_states) / sizeof(I2C_states[0]); ++state) {
+        if (I2C_states[state] == bus->state) {
+            return state;
+        }
+    }
+    return TRACE_I2C_UNKNOWN;
+}
+
+#ifdef KERNEL_TRACE
+/**
+ * Record the state of the bus on the trace
+ * @param bus context of the bus
+ */
+static void I2C_traceState(i2c_bus_t* bus) {
+    TRACE(TRACE_I2C_STATE, I2C_stateNumber(bus), (uint16_t) (uintptr_t) bus);
+}
+#define I2C_TRACE_STATE(bus) I2C_traceState(bus)
+#else
+#define I2C_TRACE_STATE(bus)
+#endif
     
+/// Record of a bus in the snapshot: state, queues and counters
+#define I2C_SNAPSHOT_SIZE (16 + 6 * I2C_PRIORITY_LEVELS)
+
 #define I2C "I2C"
 static string_data_t _MODULE_I2C = {I2C, sizeof (I2C)};
-/// define depth queue
-#define I2C_QUEUE_DEPTH     3
-/// Define I2C queue
-typedef struct tag_I2Cqueue {
-    bool pending;                   ///< If the I2C message is in pending
-    bool rW;                        ///< type of message
-    unsigned char command;          ///< Command
-    unsigned char* pcommandData;    ///< Command data
-    unsigned char commandDataSize;  ///< Size of command data
-    unsigned char* pData;           ///< Pointer to additional data
-    unsigned int Size;              ///< Size of additional data
-    I2C_callbackFunc pCallback;     ///< Callback
-} I2Cqueue;
-/// Buffer I2C queue
-I2Cqueue i2c_queue[I2C_QUEUE_DEPTH];
-/// Size I2C queue
-int I2CMAXQ = 0;
-/// I2C service event
-static hEvent_t I2C_service_handle = INVALID_EVENT_HANDLE;
-/// Pointer to function
-void (* I2C_state) (void) = &I2C_idle;
-// Port busy flag.  Set true until initialized
-bool I2C_Busy = true;
-/// index into the write buffer
-unsigned int I2C_Index = 0; 
-/// Callback to return
-I2C_callbackFunc pI2C_callback = NULL;
-/// Data size to send or receive a message
-typedef struct _I2C_data_size {
-    unsigned int tx;
-    unsigned int rx;
-} I2C_data_size_t;
-I2C_data_size_t I2C_data_size = {0, 0};
-/// Type of error
-int I2C_ERROR = 0;
-
-unsigned char I2C_CommandByte = 0;
-unsigned int I2C_command_data_size = 0; ///< command data size
-
-unsigned char* pI2CBuffer = NULL; ///< pointer to buffer
-unsigned char* pI2CcommandBuffer = NULL; ///< pointer to receive  buffer
-
-hardware_bit_t* I2C_INTERRUPT;
-REGISTER I2C_CON;
-REGISTER I2C_STAT;
-REGISTER I2C_TRN;
-REGISTER I2C_RCV;
-I2C_callbackFunc res_Callback = NULL;
-
+/// Module of all buses
+hModule_t i2c_module = INVALID_MODULE_HANDLE;
 /******************************************************************************/
 /* Parsing functions                                                          */
 /******************************************************************************/
 /**
  * Trigger the I2C controller event
  */
-void I2C_trigger_service(void) {
-    trigger_event(I2C_service_handle);
+void I2C_trigger_service(i2c_bus_t* bus) {
+    trigger_event_data(bus->service, 1, &bus->arg);
 }
 /**
  * Default operation when I2C event is launched
  * @param argc unused
- * @param argv unused
+ * @param argv context of the bus in argv[0]
  */
-void serviceI2C(int argc, int* argv) {
-    if (REGISTER_MASK_READ(I2C_CON, MASK_I2CCON_EN) == 0) ///< I2C is off
+void serviceI2C(int argc, event_arg_t* argv) {
+    i2c_bus_t* bus = (i2c_bus_t*) argv[0];
+    if (REGISTER_MASK_READ(bus->CON, MASK_I2CCON_EN) == 0) ///< I2C is off
     {
-        I2C_state = &I2C_idle; ///< disable response to any interrupts
-        I2C_load(); //< turn the I2C back on
+        bus->state = &I2C_idle; ///< disable response to any interrupts
+        I2C_load(bus); //< turn the I2C back on
         ///< Put something here to reset state machine.  Make sure attached services exit nicely.
     }
 }
+/**
+ * Check the bus from the recovery task
+ * @param argc unused
+ * @param argv context of the bus in argv[0]
+ */
+void serviceI2C_watchdog(int argc, event_arg_t* argv) {
+    i2c_bus_t* bus = (i2c_bus_t*) argv[0];
+    int priority;
+    if (bus->state != &I2C_idle) {
+        // Transaction in progress
+        if (bus->recovery.timeout > 0
+                && task_get_ticks() - bus->started.ticks > bus->recovery.timeout) {
+            bus->stats.timeouts++;
+            I2C_reset(bus);
+        }
+        return;
+    }
+    // Messages in queue without a transaction: the controller is stuck
+    for (priority = 0; priority < I2C_PRIORITY_LEVELS; priority++) {
+        if (bus->ring[priority].head != bus->ring[priority].tail) {
+            if (I2C_CheckAvailable(bus)) {
+                I2C_serve_queue(bus);
+            } else if (bus->busy == false) {
+                I2C_reset(bus);
+            }
+            return;
+        }
+    }
+}
 
-inline void I2C_manager (void) {
-    (* I2C_state) (); // execute the service routine
-    return;
+/**
+ * Bus collision: the controller drops the transaction and waits in idle.
+ * The flag is cleared, the transaction is retried according to the policy.
+ * Without retries left the bus is stuck, a peripheral holds SDA low: with
+ * the recovery pins the bus is cleared with a reset, otherwise the
+ * transaction fails and the messages in queue are kept.
+ * @param bus context of the bus
+ */
+static void I2C_collision(i2c_bus_t* bus) {
+    bus->stats.collisions++;
+    REGISTER_MASK_SET_LOW(bus->STAT, MASK_I2CSTAT_BCL);
+    if (bus->state == &I2C_idle) {
+        return;
+    }
+    if (bus->recovery.policy == I2C_RECOVERY_RETRY && bus->attempt < bus->recovery.retries) {
+        bus->attempt++;
+        bus->stats.retries++;
+        I2C_startTransaction(bus);
+        /// Set high interrupt
+        REGISTER_MASK_SET_HIGH(bus->INTERRUPT->REG, bus->INTERRUPT->CS_mask);
+        return;
+    }
+    if (bus->recovery.scl != NULL) {
+        I2C_reset(bus);
+        return;
+    }
+    I2C_doneFailed(bus);
 }
 
-hEvent_t I2C_Init(hardware_bit_t* i2c_interrupt, REGISTER i2c_con, REGISTER i2c_stat, REGISTER i2c_trn, REGISTER i2c_rcv, I2C_callbackFunc resetCallback) {
+inline void I2C_manager (i2c_bus_t* bus) {
+#ifdef KERNEL_TRACE
+    i2c_state_func_t previous = bus->state;
+#endif
+    bus->stats.interrupts++;
+    if (REGISTER_MASK_READ(bus->STAT, MASK_I2CSTAT_BCL)) {
+        I2C_collision(bus);
+    } else {
+        (* bus->state) (bus); // execute the service routine
+    }
+#ifdef KERNEL_TRACE
+    if (bus->state != previous) {
+        I2C_TRACE_STATE(bus);
+    }
+#endif
+    return;
+}
 
-    I2C_INTERRUPT = i2c_interrupt;
-    I2C_CON = i2c_con;
-    I2C_STAT = i2c_stat;
-    I2C_TRN = i2c_trn;
-    I2C_RCV = i2c_rcv;
-    res_Callback = resetCallback;
-    /// Register module
-    hModule_t i2c_module = register_module(&_MODULE_I2C);
+hEvent_t I2C_Init(i2c_bus_t* bus, hardware_bit_t* i2c_interrupt, REGISTER i2c_con, REGISTER i2c_stat, REGISTER i2c_trn, REGISTER i2c_rcv, I2C_resetFunc resetCallback) {
+
+    bus->INTERRUPT = i2c_interrupt;
+    bus->CON = i2c_con;
+    bus->STAT = i2c_stat;
+    bus->TRN = i2c_trn;
+    bus->RCV = i2c_rcv;
+    bus->reset_callback = resetCallback;
+    bus->arg = (event_arg_t) bus;
+    bus->watchdog = INVALID_EVENT_HANDLE;
+    memset(&bus->recovery, 0, sizeof(i2c_recovery_t));
+    bus->state = &I2C_idle;
+    bus->busy = true;
+    bus->error = 0;
+    bus->next_handle = 0;
+    bus->ring[I2C_PRIORITY_NORMAL].buffer = bus->queue;
+    bus->ring[I2C_PRIORITY_NORMAL].mask = I2C_QUEUE_DEPTH - 1;
+    bus->ring[I2C_PRIORITY_HIGH].buffer = bus->queue_high;
+    bus->ring[I2C_PRIORITY_HIGH].mask = I2C_QUEUE_HIGH_DEPTH - 1;
+    memset(&bus->ring[I2C_PRIORITY_NORMAL].stats, 0, sizeof(i2c_queue_stats_t));
+    memset(&bus->ring[I2C_PRIORITY_HIGH].stats, 0, sizeof(i2c_queue_stats_t));
+    I2C_resetStats(bus);
+    if (i2c_module == INVALID_MODULE_HANDLE) {
+        /// Register module
+        i2c_module = register_module(&_MODULE_I2C);
+    }
     /// Register event
-    I2C_service_handle = register_event_p(i2c_module, &serviceI2C, EVENT_PRIORITY_LOW);
+    bus->service = register_event_p(i2c_module, &serviceI2C, EVENT_PRIORITY_LOW);
     
-    I2C_load();
-    return I2C_service_handle;
+    I2C_load(bus);
+    return bus->service;
 }
 
 /**
  * Initialize the I2C queue buffer and reset state of I2C controller
  */
-void I2C_load(void) {
-    int queueIndex;
+void I2C_load(i2c_bus_t* bus) {
+    int priority;
 
-    for (queueIndex = 0; queueIndex < I2C_QUEUE_DEPTH; queueIndex++) {
-        i2c_queue[queueIndex].pending = false;
-        i2c_queue[queueIndex].rW = 0;
-        i2c_queue[queueIndex].command = 0;
-        i2c_queue[queueIndex].pcommandData = NULL;
-        i2c_queue[queueIndex].commandDataSize = 0;
-        i2c_queue[queueIndex].pData = NULL;
-        i2c_queue[queueIndex].Size = 0;
-        i2c_queue[queueIndex].pCallback = NULL;
+    for (priority = 0; priority < I2C_PRIORITY_LEVELS; priority++) {
+        bus->ring[priority].head = 0;
+        bus->ring[priority].tail = 0;
     }
     
-    REGISTER_MASK_SET_HIGH(I2C_CON, MASK_I2CCON_EN);
+    REGISTER_MASK_SET_HIGH(bus->CON, MASK_I2CCON_EN);
     /// Set low interrupt
-    REGISTER_MASK_SET_LOW(I2C_INTERRUPT->REG, I2C_INTERRUPT->CS_mask);
+    REGISTER_MASK_SET_LOW(bus->INTERRUPT->REG, bus->INTERRUPT->CS_mask);
     
     /// Set available
-    I2C_Busy = false;
+    bus->busy = false;
 }
 
 /**
- * Reset the I2C module
+ * Half period of the recovery clock
+ */
+static inline void I2C_delay(void) {
+    volatile unsigned int i;
+    for (i = 0; i < I2C_RECOVERY_DELAY; ++i);
+}
+/**
+ * Drive the pins as open drain, the bit is low as output and released
+ * (pulled up) as input
+ * @param pin the pin
+ * @param level level of the line
+ */
+static inline void I2C_line(gpio_t* pin, bool level) {
+    if (level) {
+        REGISTER_MASK_SET_HIGH(pin->CS_TRIS, pin->CS_mask);
+    } else {
+        REGISTER_MASK_SET_LOW(pin->CS_TRIS, pin->CS_mask);
+    }
+    I2C_delay();
+}
+/**
+ * Clock out the peripheral that holds SDA low, up to nine pulses on SCL,
+ * and close with a stop condition. The controller must be disabled.
  */
-void I2C_reset(void) {
-    I2C_state = &I2C_idle; // disable the response to any more interrupts
+void I2C_clearBus(i2c_bus_t* bus) {
+    gpio_t* scl = bus->recovery.scl;
+    gpio_t* sda = bus->recovery.sda;
+    unsigned char pulse;
+    if (scl == NULL || sda == NULL) {
+        return;
+    }
+    REGISTER_MASK_SET_LOW(scl->CS_LAT, scl->CS_mask);
+    REGISTER_MASK_SET_LOW(sda->CS_LAT, sda->CS_mask);
+    I2C_line(sda, true);
+    for (pulse = 0; pulse < I2C_RECOVERY_PULSES; ++pulse) {
+        I2C_line(scl, false);
+        I2C_line(scl, true);
+        if (REGISTER_MASK_READ(sda->CS_PORT, sda->CS_mask)) {
+            break;
+        }
+    }
+    // Stop condition: SDA rises while SCL is high
+    I2C_line(scl, false);
+    I2C_line(sda, false);
+    I2C_line(scl, true);
+    I2C_line(sda, true);
+}
+/**
+ * Fail a message without transaction
+ * @param message the message
+ */
+void I2C_fail(i2c_message_t* message) {
+    if (message->pCallback != NULL)
+        message->pCallback(message->handle, false, 0, message->context);
+}
+/**
+ * Abort the transaction, clear the bus and initialize the controller.
+ * The queue is kept, the transaction and the messages in queue are
+ * retried or failed according to the policy.
+ */
+void I2C_reset(i2c_bus_t* bus) {
+    bool running = (bus->state != &I2C_idle);
+    i2c_ring_t* ring;
+    i2c_message_t message;
+    critical_t section;
+    uint8_t head;
+    int priority;
+    
+    bus->state = &I2C_idle; // disable the response to any more interrupts
+    I2C_TRACE_STATE(bus);
     
-    I2C_ERROR = *I2C_STAT; // record the error for diagnostics
+    bus->error = *bus->STAT; // record the error for diagnostics
+    bus->stats.resets++;
     
-    REGISTER_MASK_SET_LOW(I2C_CON, MASK_I2CCON_EN);
+    REGISTER_MASK_SET_LOW(bus->CON, MASK_I2CCON_EN);
+
+    if (bus->reset_callback != NULL)
+        bus->reset_callback(true);
 
-    res_Callback(true);
+    I2C_clearBus(bus);
 
-    *I2C_CON = 0x1000;
+    *bus->CON = 0x1000;
     
-    *I2C_STAT = 0x0000;
+    *bus->STAT = 0x0000;
     
-    I2C_load(); //< turn the I2C back on
+    REGISTER_MASK_SET_HIGH(bus->CON, MASK_I2CCON_EN);
+    REGISTER_MASK_SET_LOW(bus->INTERRUPT->REG, bus->INTERRUPT->CS_mask);
+    // Hold the bus, the callbacks can submit new messages
+    bus->busy = true;
+    if (running) {
+        if (bus->recovery.policy == I2C_RECOVERY_RETRY && bus->attempt < bus->recovery.retries) {
+            bus->attempt++;
+            bus->stats.retries++;
+            I2C_startTransaction(bus);
+            /// Set high interrupt
+            REGISTER_MASK_SET_HIGH(bus->INTERRUPT->REG, bus->INTERRUPT->CS_mask);
+            return;
+        }
+        I2C_account(bus, false);
+        if (bus->current.pCallback != NULL)
+            bus->current.pCallback(bus->current.handle, false, bus->transferred, bus->current.context);
+    }
+    if (bus->recovery.policy == I2C_RECOVERY_FAIL) {
+        // Fail only the messages queued before the recovery
+        for (priority = I2C_PRIORITY_LEVELS - 1; priority >= 0; priority--) {
+            ring = &bus->ring[priority];
+            head = ring->head;
+            while (ring->tail != head) {
+                CRITICAL_ENTER(section, I2C_IPL);
+                message = ring->buffer[ring->tail++ & ring->mask];
+                CRITICAL_EXIT(section);
+                bus->stats.failed++;
+                I2C_fail(&message);
+            }
+        }
+    }
+    // Launch the next message in queue or release the controller
+    I2C_serve_queue(bus);
     return;
 }
-
-bool I2C_checkACK(unsigned int command, I2C_callbackFunc pCallback) {
-    if (!I2C_CheckAvailable()) return false;
-
-    pI2C_callback = pCallback;
-
-    I2C_command_data_size = 0;
-    I2C_CommandByte = command;
-    pI2CBuffer = NULL;
-    
-    I2C_data_size.tx = 0; // tx data size
-    I2C_data_size.rx = 0; // rx data size
-
-    // Set ISR callback and trigger the ISR
-    I2C_state = &I2C_startWrite;
-    /// Set high interrupt
-    REGISTER_MASK_SET_HIGH(I2C_INTERRUPT->REG, I2C_INTERRUPT->CS_mask);
-    return true;
+/**
+ * Add a latency to the statistics
+ * @param latency statistics to update
+ * @param time latency in [uS]
+ */
+static inline void I2C_latency(i2c_latency_t* latency, uint32_t time) {
+    latency->total += time;
+    if (time > latency->max) {
+        latency->max = (time > 0xFFFF) ? 0xFFFF : time;
+    }
 }
 /**
- * Send the message with additional data
- * @param command command data usually the address of peripherals
- * @param pcommandData additional message
- * @param commandDataSize size of additional message
- * @param rW type of message
- * @param ptrxData pointer to data
- * @param trxSize size of data
- * @param pCallback Callback when the controller complete or fail to send the message
- * @return status of sending message
+ * Update the counters at the end of a transaction
+ * @param bus context of the bus
+ * @param state true if the transaction is completed
  */
-void I2C_loadCommand(unsigned char command, unsigned char* pcommandData, unsigned char commandDataSize, unsigned short rW, unsigned char* ptrxData, unsigned int trxSize, I2C_callbackFunc pCallback) {
-    
-    pI2C_callback = pCallback;
-    I2C_CommandByte = command;
-    pI2CcommandBuffer = pcommandData;
-    I2C_command_data_size = commandDataSize;
-    pI2CBuffer = ptrxData;
-
-    if (rW == I2C_COMMAND_WRITE) {
-        I2C_data_size.tx = trxSize; // tx data size
-        I2C_data_size.rx = 0; // rx data size
+void I2C_account(i2c_bus_t* bus, bool state) {
+    uint32_t time = event_counts_us(event_elapsed(&bus->started));
+    unsigned char command = bus->current.count > 0 ? bus->current.message[0].command : 0;
+    i2c_device_stats_t* device = NULL;
+    unsigned char i;
+    if (bus->current.segments != NULL) {
+        command = bus->current.segments[0].command;
+    }
+    if (state) {
+        bus->stats.transactions++;
     } else {
-        I2C_data_size.tx = 0; // tx data size
-        I2C_data_size.rx = trxSize; // rx data size
+        bus->stats.failed++;
+    }
+    I2C_latency(&bus->stats.bus_time, time);
+    // Find the peripheral or a new place in the table
+    for (i = 0; i < bus->devices_used; ++i) {
+        if (bus->devices[i].command == command) {
+            device = &bus->devices[i];
+            break;
+        }
     }
+    if (device == NULL && bus->devices_used < I2C_DEVICE_STATS) {
+        device = &bus->devices[bus->devices_used++];
+        memset(device, 0, sizeof(i2c_device_stats_t));
+        device->command = command;
+    }
+    if (device != NULL) {
+        if (state) {
+            device->transactions++;
+        } else {
+            device->failed++;
+        }
+        device->bytes += bus->bytes;
+        device->bus_time += time;
+    }
+}
+/**
+ * Start from the first segment the transaction of the current message
+ * @param bus context of the bus
+ */
+void I2C_startTransaction(i2c_bus_t* bus) {
+    // A single message uses its own segments
+    bus->segment = (bus->current.segments != NULL) ? bus->current.segments : bus->current.message;
+    bus->segments_left = bus->current.count;
+    event_stamp(&bus->started);
+    bus->bytes = 0;
+    bus->transferred = 0;
     // Set ISR callback and trigger the ISR
-    I2C_state = &I2C_startWrite;
+    bus->state = &I2C_startWrite;
+    I2C_TRACE_STATE(bus);
 }
 /**
- * Load in buffer the message with additional data
+ * Start the transaction of a message
+ * @param bus context of the bus
+ * @param pQueue message to send
+ */
+void I2C_loadCommand(i2c_bus_t* bus, i2c_message_t* pQueue) {
+    bus->current = *pQueue;
+    bus->attempt = 0;
+    I2C_startTransaction(bus);
+    I2C_latency(&bus->stats.queue_wait, event_counts_us(event_elapsed(&bus->current.submitted)));
+}
+/**
+ * Load in buffer the message
+ * @param bus context of the bus
+ * @param pMessage message to copy in queue
+ * @param priority queue to use
+ * @return handle of the message, INVALID_I2C_HANDLE if the queue is full
+ */
+hI2C_t I2C_loadBuffer(i2c_bus_t* bus, i2c_message_t* pMessage, i2c_priority_t priority) {
+    i2c_ring_t* ring = &bus->ring[priority];
+    critical_t section;
+    hI2C_t handle;
+    uint8_t used;
+    event_stamp(&pMessage->submitted);
+    // Submitters on different priorities share the slot and the handles
+    CRITICAL_ENTER(section, I2C_IPL);
+    used = ring->head - ring->tail;
+    if (used > ring->mask) {
+        ring->stats.rejected++;
+        CRITICAL_EXIT(section);
+        return INVALID_I2C_HANDLE;
+    }
+    handle = bus->next_handle++;
+    if (bus->next_handle == INVALID_I2C_HANDLE) {
+        bus->next_handle = 0;
+    }
+    pMessage->handle = handle;
+    ring->buffer[ring->head & ring->mask] = *pMessage;
+    // Publish the message after it is complete
+    ring->head++;
+    ring->stats.submitted++;
+    if (++used > ring->stats.max_used) {
+        ring->stats.max_used = used;
+    }
+    CRITICAL_EXIT(section);
+    return handle;
+}
+/**
+ * Queue the message and, if the controller is free, start to serve the queue
+ * @param bus context of the bus
+ * @param pMessage message to send
+ * @param priority queue to use
+ * @return handle of the message, INVALID_I2C_HANDLE if the queue is full
+ */
+hI2C_t I2C_submit(i2c_bus_t* bus, i2c_message_t* pMessage, i2c_priority_t priority) {
+    hI2C_t handle = I2C_loadBuffer(bus, pMessage, priority);
+    if (handle == INVALID_I2C_HANDLE) {
+        return INVALID_I2C_HANDLE;
+    }
+    // If the controller is busy, the message is served at the end of the current one
+    if (I2C_CheckAvailable(bus)) {
+        I2C_serve_queue(bus);
+    }
+    return handle;
+}
+/**
+ * Build and queue a single message: command data and data, with a repeated
+ * start before the data to read
+ * @param bus context of the bus
  * @param command command data usually the address of peripherals
  * @param pcommandData additional message
  * @param commandDataSize size of additional message
@@ -269,294 +550,384 @@ void I2C_loadCommand(unsigned char command, unsigned char* pcommandData, unsigne
  * @param ptrxData pointer to data
  * @param trxSize size of data
  * @param pCallback Callback when the controller complete or fail to send the message
- * @return status of sending message
- */
-i2c_state_t I2C_loadBuffer(unsigned char command, unsigned char* pcommandData, unsigned char commandDataSize, unsigned short rW, unsigned char* ptrxData, unsigned int trxSize, I2C_callbackFunc pCallback) {
-    int queueIndex;
-    if (I2CMAXQ < I2C_QUEUE_DEPTH) {
-        for (queueIndex = 0; queueIndex < I2C_QUEUE_DEPTH; queueIndex++) {
-            if (i2c_queue[queueIndex].pending == false) {
-                i2c_queue[queueIndex].pending = true;
-                i2c_queue[queueIndex].rW = rW;
-                i2c_queue[queueIndex].command = command;
-                i2c_queue[queueIndex].pcommandData = pcommandData;
-                i2c_queue[queueIndex].commandDataSize = commandDataSize;
-                i2c_queue[queueIndex].pData = ptrxData;
-                i2c_queue[queueIndex].Size = trxSize;
-                i2c_queue[queueIndex].pCallback = pCallback;
-                I2CMAXQ++;
-                return PENDING;
-            }
-        }
+ * @param context user data for the callback
+ * @param priority queue to use
+ * @return handle of the message, INVALID_I2C_HANDLE if not accepted
+ */
+hI2C_t I2C_submitMessage(i2c_bus_t* bus, unsigned char command, unsigned char* pcommandData, unsigned char commandDataSize, unsigned char rW, unsigned char* ptrxData, unsigned int trxSize, I2C_callbackFunc pCallback, void* context, i2c_priority_t priority) {
+    i2c_message_t message;
+    i2c_segment_t* segment = message.message;
+    if (rW == I2C_SEGMENT_READ && (trxSize == 0 || ptrxData == NULL)) {
+        return INVALID_I2C_HANDLE;
+    }
+    // The command data is not sent before a read without command
+    if (commandDataSize > 0 || rW == I2C_SEGMENT_WRITE) {
+        segment->command = command;
+        segment->flags = I2C_SEGMENT_WRITE;
+        segment->pData = pcommandData;
+        segment->size = commandDataSize;
+        segment++;
     }
-    return false;
+    segment->command = command;
+    segment->flags = rW;
+    segment->pData = ptrxData;
+    segment->size = trxSize;
+    message.segments = NULL;
+    message.count = segment - message.message + 1;
+    message.pCallback = pCallback;
+    message.context = context;
+    return I2C_submit(bus, &message, priority);
 }
 
-i2c_state_t I2C_Write(unsigned char command, unsigned char* pcommandData, unsigned char commandDataSize, I2C_callbackFunc pCallback) {
-    return I2C_Write_data(command, pcommandData, commandDataSize, NULL, 0, pCallback);
+hI2C_t I2C_checkACK(i2c_bus_t* bus, unsigned int command, I2C_callbackFunc pCallback, void* context) {
+    return I2C_submitMessage(bus, command, NULL, 0, I2C_SEGMENT_WRITE, NULL, 0, pCallback, context, I2C_PRIORITY_NORMAL);
 }
 
-i2c_state_t I2C_Write_data(unsigned char command, unsigned char* pcommandData, unsigned char commandDataSize, unsigned char* ptxData, unsigned int txSize, I2C_callbackFunc pCallback) {
+hI2C_t I2C_Write(i2c_bus_t* bus, unsigned char command, unsigned char* pcommandData, unsigned char commandDataSize, I2C_callbackFunc pCallback, void* context) {
+    return I2C_Write_data(bus, command, pcommandData, commandDataSize, NULL, 0, pCallback, context);
+}
 
-    // Try to direct send the message
-    if (I2C_CheckAvailable() && (I2CMAXQ < I2C_QUEUE_DEPTH)) {
-        I2C_loadCommand(command, pcommandData, commandDataSize, I2C_COMMAND_WRITE, ptxData, txSize, pCallback);
-        /// Set high interrupt
-        REGISTER_MASK_SET_HIGH(I2C_INTERRUPT->REG, I2C_INTERRUPT->CS_mask);
-    } else {
-        return I2C_loadBuffer(command, pcommandData, commandDataSize, I2C_COMMAND_WRITE, ptxData, txSize, pCallback);
+hI2C_t I2C_Write_data(i2c_bus_t* bus, unsigned char command, unsigned char* pcommandData, unsigned char commandDataSize, unsigned char* ptxData, unsigned int txSize, I2C_callbackFunc pCallback, void* context) {
+    return I2C_submitMessage(bus, command, pcommandData, commandDataSize, I2C_SEGMENT_WRITE, ptxData, txSize, pCallback, context, I2C_PRIORITY_NORMAL);
+}
+
+hI2C_t I2C_Write_data_p(i2c_bus_t* bus, unsigned char command, unsigned char* pcommandData, unsigned char commandDataSize, unsigned char* ptxData, unsigned int txSize, I2C_callbackFunc pCallback, void* context, i2c_priority_t priority) {
+    return I2C_submitMessage(bus, command, pcommandData, commandDataSize, I2C_SEGMENT_WRITE, ptxData, txSize, pCallback, context, priority);
+}
+
+hI2C_t I2C_Read(i2c_bus_t* bus, unsigned char command, unsigned char* pcommandData, unsigned char commandDataSize, unsigned char* prxData, unsigned int rxSize, I2C_callbackFunc pCallback, void* context) {
+    return I2C_submitMessage(bus, command, pcommandData, commandDataSize, I2C_SEGMENT_READ, prxData, rxSize, pCallback, context, I2C_PRIORITY_NORMAL);
+}
+
+hI2C_t I2C_Read_p(i2c_bus_t* bus, unsigned char command, unsigned char* pcommandData, unsigned char commandDataSize, unsigned char* prxData, unsigned int rxSize, I2C_callbackFunc pCallback, void* context, i2c_priority_t priority) {
+    return I2C_submitMessage(bus, command, pcommandData, commandDataSize, I2C_SEGMENT_READ, prxData, rxSize, pCallback, context, priority);
+}
+
+hI2C_t I2C_Transaction(i2c_bus_t* bus, i2c_segment_t* segments, unsigned char count, I2C_callbackFunc pCallback, void* context) {
+    return I2C_Transaction_p(bus, segments, count, pCallback, context, I2C_PRIORITY_NORMAL);
+}
+
+hI2C_t I2C_Transaction_p(i2c_bus_t* bus, i2c_segment_t* segments, unsigned char count, I2C_callbackFunc pCallback, void* context, i2c_priority_t priority) {
+    i2c_message_t message;
+    unsigned char i;
+    if (count == 0) {
+        return INVALID_I2C_HANDLE;
     }
-    return true;
+    // Every read phase receives at least one byte
+    for (i = 0; i < count; ++i) {
+        if ((segments[i].flags & I2C_SEGMENT_READ) && (segments[i].size == 0 || segments[i].pData == NULL)) {
+            return INVALID_I2C_HANDLE;
+        }
+    }
+    message.segments = segments;
+    message.count = count;
+    message.pCallback = pCallback;
+    message.context = context;
+    return I2C_submit(bus, &message, priority);
 }
 
-i2c_state_t I2C_Read(unsigned char command, unsigned char* pcommandData, unsigned char commandDataSize, unsigned char* prxData, unsigned int rxSize, I2C_callbackFunc pCallback) {
+hTask_t I2C_setRecovery(i2c_bus_t* bus, const i2c_recovery_t* recovery, frequency_t frequency) {
+    hTask_t task;
+    bus->recovery = *recovery;
+    if (bus->watchdog == INVALID_EVENT_HANDLE) {
+        /// Register event
+        bus->watchdog = register_event_p(i2c_module, &serviceI2C_watchdog, EVENT_PRIORITY_LOW);
+        if (bus->watchdog == INVALID_EVENT_HANDLE) {
+            return INVALID_TASK_HANDLE;
+        }
+    }
+    task = task_load_data(bus->watchdog, frequency, 1, (event_arg_t) bus);
+    /// Run task
+    task_set(task, RUN);
+    return task;
+}
 
-    // Try to direct send the message
-    if (I2C_CheckAvailable() && (I2CMAXQ < I2C_QUEUE_DEPTH)) {
-        I2C_loadCommand(command, pcommandData, commandDataSize, I2C_COMMAND_READ, prxData, rxSize, pCallback);
-        /// Set high interrupt
-        REGISTER_MASK_SET_HIGH(I2C_INTERRUPT->REG, I2C_INTERRUPT->CS_mask);
-    } else {
-        return I2C_loadBuffer(command, pcommandData, commandDataSize, I2C_COMMAND_READ, prxData, rxSize, pCallback);
+void I2C_getQueueStats(i2c_bus_t* bus, i2c_priority_t priority, i2c_queue_stats_t* stats) {
+    *stats = bus->ring[priority].stats;
+    stats->used = bus->ring[priority].head - bus->ring[priority].tail;
+}
+
+void I2C_getBusStats(i2c_bus_t* bus, i2c_bus_stats_t* stats) {
+    *stats = bus->stats;
+}
+
+unsigned char I2C_getDeviceStats(i2c_bus_t* bus, i2c_device_stats_t* stats, unsigned char len) {
+    unsigned char i;
+    for (i = 0; i < bus->devices_used && i < len; ++i) {
+        stats[i] = bus->devices[i];
     }
-    return true;
+    return i;
+}
+
+void I2C_snapshot(snapshot_t* snapshot, void* context) {
+    i2c_bus_t* bus = (i2c_bus_t*) context;
+    i2c_queue_stats_t queue;
+    i2c_bus_stats_t stats;
+    unsigned short priority;
+    snapshot_section(snapshot, SNAPSHOT_I2C, I2C_SNAPSHOT_SIZE, 1);
+    snapshot_put8(snapshot, I2C_stateNumber(bus));
+    snapshot_put8(snapshot, I2C_PRIORITY_LEVELS);
+    for (priority = 0; priority < I2C_PRIORITY_LEVELS; ++priority) {
+        I2C_getQueueStats(bus, priority, &queue);
+        snapshot_put8(snapshot, queue.used);
+        snapshot_put8(snapshot, queue.max_used);
+        snapshot_put16(snapshot, queue.submitted);
+        snapshot_put16(snapshot, queue.rejected);
+    }
+    I2C_getBusStats(bus, &stats);
+    snapshot_put16(snapshot, stats.transactions);
+    snapshot_put16(snapshot, stats.failed);
+    snapshot_put16(snapshot, stats.nacks);
+    snapshot_put16(snapshot, stats.collisions);
+    snapshot_put16(snapshot, stats.resets);
+    snapshot_put16(snapshot, stats.timeouts);
+    snapshot_put16(snapshot, stats.retries);
+}
+
+void I2C_resetStats(i2c_bus_t* bus) {
+    memset(&bus->stats, 0, sizeof(i2c_bus_stats_t));
+    bus->devices_used = 0;
 }
 
 /**
- * Serve all I2C messages in pending
+ * Start the oldest message in queue, high priority messages first.
+ * If the queue is empty release the controller.
  */
-void I2C_serve_queue(void) {
-    int queueIndex;
-    for (queueIndex = 0; queueIndex < I2C_QUEUE_DEPTH; queueIndex++) {
-        if (i2c_queue[queueIndex].pending == true) {
+void I2C_serve_queue(i2c_bus_t* bus) {
+    int priority;
+    i2c_ring_t* ring;
+    critical_t section;
+    for (priority = I2C_PRIORITY_LEVELS - 1; priority >= 0; priority--) {
+        ring = &bus->ring[priority];
+        CRITICAL_ENTER(section, I2C_IPL);
+        if (ring->head != ring->tail) {
             // Send message to I2C
-            I2C_loadCommand(i2c_queue[queueIndex].command, i2c_queue[queueIndex].pcommandData, i2c_queue[queueIndex].commandDataSize, 
-                    i2c_queue[queueIndex].rW, i2c_queue[queueIndex].pData, i2c_queue[queueIndex].Size, i2c_queue[queueIndex].pCallback);
-            //decrease queue
-            I2CMAXQ--;
-            i2c_queue[queueIndex].pending = false;
+            I2C_loadCommand(bus, &ring->buffer[ring->tail & ring->mask]);
+            ring->tail++;
+            CRITICAL_EXIT(section);
+            /// Set high interrupt
+            REGISTER_MASK_SET_HIGH(bus->INTERRUPT->REG, bus->INTERRUPT->CS_mask);
+            return;
         }
+        CRITICAL_EXIT(section);
     }
+    bus->busy = false;
 }
 /**
  * Check the I2C is available
  * @return state of I2C
  */
-inline bool I2C_CheckAvailable(void) {
-    if (REGISTER_MASK_READ(I2C_CON, MASK_I2CCON_EN) == 0) return false;
-    if (REGISTER_MASK_READ(I2C_STAT, 0b0000010011000000) != 0) return false;
-
-    if (I2C_Busy == true) return false;
-    I2C_Busy = true;
+inline bool I2C_CheckAvailable(i2c_bus_t* bus) {
+    critical_t section;
+    bool available = false;
+    if (REGISTER_MASK_READ(bus->CON, MASK_I2CCON_EN) == 0) return false;
+    if (REGISTER_MASK_READ(bus->STAT, 0b0000010011000000) != 0) return false;
+
+    // Take the bus: only the owner moves the tail of the queues
+    CRITICAL_ENTER(section, I2C_IPL);
+    if (bus->busy == false) {
+        bus->busy = true;
+        available = true;
+    }
+    CRITICAL_EXIT(section);
 
+    return available;
+}
+/**
+ * Move to the next segment of the transaction
+ * @return false at the end of the transaction
+ */
+static inline bool I2C_nextSegment(i2c_bus_t* bus) {
+    if (--bus->segments_left == 0) {
+        return false;
+    }
+    bus->segment++;
+    bus->index = 0;
     return true;
 }
 /**
  * Enable write message in controller
  */
-void I2C_startWrite(void) {
-    I2C_Index = 0; // Reset index into buffer
+void I2C_startWrite(i2c_bus_t* bus) {
+    bus->index = 0; // Reset index into buffer
 
-    I2C_state = &I2C_writeCommand;
-    REGISTER_MASK_SET_HIGH(I2C_CON, MASK_I2CCON_SEN);
+    bus->state = &I2C_writeCommand;
+    REGISTER_MASK_SET_HIGH(bus->CON, MASK_I2CCON_SEN);
     return;
 }
 /**
- * Write the command message (usually the address of peripherals
+ * Repeated start, to change direction or peripheral without release the bus
  */
-void I2C_writeCommand(void) {
-    *(I2C_TRN) = I2C_CommandByte & 0xFE;
-    I2C_state = &I2C_writeCommandData;
+void I2C_restart(i2c_bus_t* bus) {
+    bus->state = &I2C_writeCommand;
+    REGISTER_MASK_SET_HIGH(bus->CON, MASK_I2CCON_RSEN);
     return;
 }
 /**
- * If the ACK return true send the command data and jump to read/write operation
+ * Write the command message (usually the address of peripherals) with
+ * the direction of the segment
  */
-void I2C_writeCommandData(void) {
-    if (REGISTER_MASK_READ(I2C_STAT, MASK_I2CSTAT_ACKSTAT) == 1) {
-        // Device not responding
-        I2C_Failed();
-        return;
-    }
-
-    // If there is no command data, do not send any, do a stop.
-    if (I2C_command_data_size == 0) {
-        I2C_writeStop();
-        return;
-    }
-
-    *(I2C_TRN) = pI2CcommandBuffer[I2C_Index++];
-
-    if (I2C_Index >= I2C_command_data_size) {
-        I2C_Index = 0; // Reset index into the buffer
-
-        if (I2C_data_size.rx == I2C_COMMAND_READ)
-            I2C_state = &I2C_readStart;
-        else
-            I2C_state = &I2C_writeData;
+void I2C_writeCommand(i2c_bus_t* bus) {
+    if (bus->segment->flags & I2C_SEGMENT_READ) {
+        bus->state = &I2C_recen;
+        *(bus->TRN) = bus->segment->command | 0x01;
+    } else {
+        bus->state = &I2C_writeData;
+        *(bus->TRN) = bus->segment->command & 0xFE;
     }
+    bus->stats.bytes_tx++;
+    bus->bytes++;
     return;
 }
 
 /* READ FUNCTIONS */
 
-/**
- * Start read operation
- */
-void I2C_readStart(void) {
-    I2C_Index = 0; // Reset index into buffer
-    I2C_state = &I2C_readCommand;
-    REGISTER_MASK_SET_HIGH(I2C_CON, MASK_I2CCON_SEN);
-}
-/**
- * Send write command message
- */
-void I2C_readCommand(void) {
-    I2C_state = &I2C_recen;
-    *(I2C_TRN) = I2C_CommandByte | 0x01;
-}
 /**
  * Check the peripherals responding and start reading operation
  */
-void I2C_recen(void) {
-    if (REGISTER_MASK_READ(I2C_STAT, MASK_I2CSTAT_ACKSTAT) == 1) {
+void I2C_recen(i2c_bus_t* bus) {
+    if (REGISTER_MASK_READ(bus->STAT, MASK_I2CSTAT_ACKSTAT) == 1) {
         // Device not responding
-        I2C_Failed();
+        bus->stats.nacks++;
+        I2C_Failed(bus);
         return;
     } else {
-        I2C_state = &I2C_recstore;
-        REGISTER_MASK_SET_HIGH(I2C_CON, MASK_I2CCON_RCEN);
+        bus->state = &I2C_recstore;
+        REGISTER_MASK_SET_HIGH(bus->CON, MASK_I2CCON_RCEN);
     }
     return;
 }
 /**
- * Store all read data in buffer
+ * Store all read data in buffer. The read phase continues on the next
+ * segments with the same peripheral (scatter), only the last byte is NACK.
  */
-void I2C_recstore(void) {
-    if(pI2CBuffer != NULL) {
-        pI2CBuffer[I2C_Index++] = *I2C_RCV;
-        if (I2C_Index >= I2C_data_size.rx) {
-            I2C_state = &I2C_stopRead;
-            REGISTER_MASK_SET_HIGH(I2C_CON, MASK_I2CCON_ACKDT);
-        } else {
-            I2C_state = &I2C_rerecen;
-            REGISTER_MASK_SET_LOW(I2C_CON, MASK_I2CCON_ACKDT);
+void I2C_recstore(i2c_bus_t* bus) {
+    bus->segment->pData[bus->index++] = *bus->RCV;
+    bus->stats.bytes_rx++;
+    bus->bytes++;
+    bus->transferred++;
+    if (bus->index >= bus->segment->size
+            && (bus->segments_left == 1 || !I2C_SEGMENT_CONTINUE(bus->segment + 1))) {
+        bus->state = &I2C_stopRead;
+        REGISTER_MASK_SET_HIGH(bus->CON, MASK_I2CCON_ACKDT);
+    } else {
+        if (bus->index >= bus->segment->size) {
+            I2C_nextSegment(bus);
         }
+        bus->state = &I2C_rerecen;
+        REGISTER_MASK_SET_LOW(bus->CON, MASK_I2CCON_ACKDT);
     }
-    REGISTER_MASK_SET_HIGH(I2C_CON, MASK_I2CCON_ACKEN);
+    REGISTER_MASK_SET_HIGH(bus->CON, MASK_I2CCON_ACKEN);
     return;
 }
 /**
- * Stop read
+ * Stop read, or repeated start if the transaction is not complete
  */
-void I2C_stopRead(void) {
-    REGISTER_MASK_SET_HIGH(I2C_CON, MASK_I2CCON_PEN);
-    I2C_state = &I2C_doneRead;
+void I2C_stopRead(i2c_bus_t* bus) {
+    if (I2C_nextSegment(bus)) {
+        I2C_restart(bus);
+        return;
+    }
+    REGISTER_MASK_SET_HIGH(bus->CON, MASK_I2CCON_PEN);
+    bus->state = &I2C_done;
     return;
 }
 /**
  * Update read operation
  */
-void I2C_rerecen(void) {
-    I2C_state = &I2C_recstore;
-    REGISTER_MASK_SET_HIGH(I2C_CON, MASK_I2CCON_RCEN);
+void I2C_rerecen(i2c_bus_t* bus) {
+    bus->state = &I2C_recstore;
+    REGISTER_MASK_SET_HIGH(bus->CON, MASK_I2CCON_RCEN);
     return;
 }
-/**
- * Done read and launch callback.
- * If the queue is not empty launch other message in queue
- */
-void I2C_doneRead(void) {
-    if (pI2C_callback != NULL)
-        pI2C_callback(true);
-    //Check I2C available and buffer not empty
-    if(I2CMAXQ > 0)
-        I2C_serve_queue();
-    else 
-        I2C_Busy = false;
-}
 
 /* WRITE FUNCTIONS */
 
 /**
- * If the ACK return true send the message
+ * If the ACK return true send the message. The write phase continues on
+ * the next segments with the same peripheral (gather).
  */
-void I2C_writeData(void) {
-    if (REGISTER_MASK_READ(I2C_STAT, MASK_I2CSTAT_ACKSTAT) == 1) {
+void I2C_writeData(i2c_bus_t* bus) {
+    if (REGISTER_MASK_READ(bus->STAT, MASK_I2CSTAT_ACKSTAT) == 1) {
         // Device not responding
-        I2C_Failed();
+        bus->stats.nacks++;
+        I2C_Failed(bus);
         return;
     }
 
-    if (I2C_data_size.tx == 0) {
-        I2C_writeStop();
-        return;
-    }
-    if (pI2CBuffer != NULL) {
-        *(I2C_TRN) = pI2CBuffer[I2C_Index++];
-        
-        if (I2C_Index >= I2C_data_size.tx) {
-            if (I2C_data_size.rx == 0)
-                I2C_state = &I2C_writeStop;
-            else
-                I2C_state = &I2C_readStart;
+    while (bus->index >= bus->segment->size) {
+        if (!I2C_nextSegment(bus)) {
+            I2C_writeStop(bus);
+            return;
+        }
+        if (!I2C_SEGMENT_CONTINUE(bus->segment)) {
+            I2C_restart(bus);
+            return;
         }
     }
+    *(bus->TRN) = bus->segment->pData[bus->index++];
+    bus->stats.bytes_tx++;
+    bus->bytes++;
+    bus->transferred++;
     return;
 }
 /**
  * Launch stop operation
  */
-void I2C_writeStop(void) {
-    I2C_state = &I2C_doneWrite;
-    REGISTER_MASK_SET_HIGH(I2C_CON, MASK_I2CCON_PEN);
+void I2C_writeStop(i2c_bus_t* bus) {
+    bus->state = &I2C_done;
+    REGISTER_MASK_SET_HIGH(bus->CON, MASK_I2CCON_PEN);
     return;
 }
+
+/* SERVICE FUNCTIONS */
+
 /**
- * Done write and launch callback.
+ * Done transaction and launch callback.
  * If the queue is not empty launch other message in queue
  */
-void I2C_doneWrite(void) {
-    if (pI2C_callback != NULL)
-        pI2C_callback(true);
-    //Check I2C available and buffer not empty
-    if(I2CMAXQ > 0)
-        I2C_serve_queue();
-    else
-        I2C_Busy = false;
+void I2C_done(i2c_bus_t* bus) {
+    bus->state = &I2C_idle;
+    I2C_account(bus, true);
+    if (bus->current.pCallback != NULL)
+        bus->current.pCallback(bus->current.handle, true, bus->transferred, bus->current.context);
+    // Launch the next message in queue or release the controller
+    I2C_serve_queue(bus);
 }
-
-/* SERVICE FUNCTIONS */
-
 /**
  * Idle operation
  */
-void I2C_idle(void) {
+void I2C_idle(i2c_bus_t* bus) {
     return;
 }
 /**
- * Stop I2C read/write and launch callback with false
+ * Stop I2C read/write, the callback is launched when the stop is complete
+ */
+void I2C_Failed(i2c_bus_t* bus) {
+    bus->state = &I2C_doneFailed;
+    REGISTER_MASK_SET_HIGH(bus->CON, MASK_I2CCON_PEN);
+}
+/**
+ * Failed transaction, launch callback with false.
+ * If the queue is not empty launch other message in queue
  */
-void I2C_Failed(void) {
-    I2C_state = &I2C_idle;
-    REGISTER_MASK_SET_HIGH(I2C_CON, MASK_I2CCON_PEN);
-    if (pI2C_callback != NULL)
-        pI2C_callback(false);
-    //Check I2C available and buffer not empty
-    if(I2CMAXQ > 0)
-        I2C_serve_queue();
-    else
-        I2C_Busy = false;
+void I2C_doneFailed(i2c_bus_t* bus) {
+    bus->state = &I2C_idle;
+    I2C_account(bus, false);
+    if (bus->current.pCallback != NULL)
+        bus->current.pCallback(bus->current.handle, false, bus->transferred, bus->current.context);
+    // Launch the next message in queue or release the controller
+    I2C_serve_queue(bus);
 }
 /**
  * Status of I2C
  * @return status I2C
  */
-bool I2C_Normal(void) {
-    if (REGISTER_MASK_READ(I2C_STAT, 0b0000010011000000) == 0)
+bool I2C_Normal(i2c_bus_t* bus) {
+    if (REGISTER_MASK_READ(bus->STAT, 0b0000010011000000) == 0)
         return true;
     else {
-        I2C_ERROR = ((unsigned int) I2C_STAT);
+        bus->error = *bus->STAT;
         return false;
     }
 }
\ No newline at end of file
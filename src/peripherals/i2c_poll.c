@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+ */
+
+/******************************************************************************/
+/* Files to Include                                                           */
+/******************************************************************************/
+
+#include <string.h>
+
+#include "peripherals/i2c_poll.h"
+
+/******************************************************************************/
+/* Global Variable Declaration                                                */
+/******************************************************************************/
+#define I2C_POLL "I2C_POLL"
+static string_data_t _MODULE_I2C_POLL = {I2C_POLL, sizeof (I2C_POLL)};
+
+/// Module of the polls
+static hModule_t i2c_poll_module = INVALID_MODULE_HANDLE;
+
+/*****************************************************************************/
+/* Communication Functions                                                   */
+/*****************************************************************************/
+/**
+ * End of the read. Swap the buffers
+ * @param request handle of the read
+ * @param state true if the sample is read
+ * @param bytes bytes read
+ * @param context poll of the read
+ */
+void I2C_poll_done(hI2C_t request, bool state, unsigned int bytes, void* context) {
+    i2c_poll_t* poll = (i2c_poll_t*) context;
+    if (state) {
+        poll->timestamp[poll->front ^ 1] = task_get_ticks();
+        poll->front ^= 1;
+        poll->samples++;
+    } else {
+        poll->failed++;
+    }
+    poll->sequence++;
+    poll->reading = false;
+}
+/**
+ * Start the read of a poll in the back buffer. The reads of the
+ * polls wait in the queue of the bus.
+ * @param poll poll to read
+ */
+void I2C_poll_start(i2c_poll_t* poll) {
+    if (poll->reading) {
+        poll->missed++;
+        return;
+    }
+    poll->reading = true;
+    // The back buffer is in writing
+    poll->sequence++;
+    if (I2C_Read(poll->bus, poll->command, &poll->reg, 1, poll->data[poll->front ^ 1], poll->size, &I2C_poll_done, poll) == INVALID_I2C_HANDLE) {
+        I2C_poll_done(INVALID_I2C_HANDLE, false, 0, poll);
+    }
+}
+/**
+ * Event launched from the task of the poll
+ * @param argc unused
+ * @param argv poll to read
+ */
+void serviceI2C_poll(int argc, event_arg_t* argv) {
+    I2C_poll_start((i2c_poll_t*) argv[0]);
+}
+
+hTask_t I2C_poll_register(i2c_poll_t* poll, i2c_bus_t* bus, unsigned char command, unsigned char reg, unsigned char size, frequency_t rate) {
+    if (size == 0 || size > I2C_POLL_MAX_SIZE) {
+        return INVALID_TASK_HANDLE;
+    }
+    memset(poll, 0, sizeof(i2c_poll_t));
+    poll->bus = bus;
+    poll->command = command;
+    poll->reg = reg;
+    poll->size = size;
+    if (i2c_poll_module == INVALID_MODULE_HANDLE) {
+        /// Register module
+        i2c_poll_module = register_module(&_MODULE_I2C_POLL);
+    }
+    /// Register event
+    poll->event = register_event_p(i2c_poll_module, &serviceI2C_poll, EVENT_PRIORITY_LOW);
+    if (poll->event == INVALID_EVENT_HANDLE) {
+        return INVALID_TASK_HANDLE;
+    }
+    poll->task = task_load_data(poll->event, rate, 1, (event_arg_t) poll);
+    if (poll->task == INVALID_TASK_HANDLE) {
+        unregister_event(poll->event);
+        return INVALID_TASK_HANDLE;
+    }
+    /// Run task
+    task_set(poll->task, RUN);
+    return poll->task;
+}
+
+bool I2C_poll_read(i2c_poll_t* poll, void* data, uint32_t* timestamp) {
+    uint16_t sequence;
+    uint8_t front;
+    do {
+        sequence = poll->sequence;
+        if (poll->samples == 0) {
+            return false;
+        }
+        front = poll->front;
+        memcpy(data, poll->data[front], poll->size);
+        if (timestamp != NULL) {
+            *timestamp = poll->timestamp[front];
+        }
+        // Copy again if a read is started or completed in the meantime
+    } while (sequence != poll->sequence);
+    return true;
+}
+
+uint32_t I2C_poll_age(i2c_poll_t* poll) {
+    uint16_t sequence;
+    uint32_t timestamp;
+    do {
+        sequence = poll->sequence;
+        if (poll->samples == 0) {
+            return I2C_POLL_NO_SAMPLE;
+        }
+        timestamp = poll->timestamp[poll->front];
+    } while (sequence != poll->sequence);
+    return task_get_ticks() - timestamp;
+}
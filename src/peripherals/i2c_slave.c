@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+ */
+
+/******************************************************************************/
+/* Files to Include                                                           */
+/******************************************************************************/
+
+#include <xc.h>
+#include <string.h>
+
+#include "peripherals/i2c_slave.h"
+#include "system/modules.h"
+#include "system/critical.h"
+
+/// Define mask type of bit
+#define MASK_I2CCON_EN           BIT_MASK(15)
+#define MASK_I2CCON_SCLREL       BIT_MASK(12)
+
+#define MASK_I2CSTAT_ACKSTAT     BIT_MASK(15)
+#define MASK_I2CSTAT_I2COV       BIT_MASK(6)
+#define MASK_I2CSTAT_D_A         BIT_MASK(5)
+#define MASK_I2CSTAT_R_W         BIT_MASK(2)
+
+/// Level to stop the slave interrupt
+#define I2C_SLAVE_IPL 7
+
+/******************************************************************************/
+/* Global Variable Declaration                                                */
+/******************************************************************************/
+
+void I2C_slave_idle(i2c_slave_t* slave);
+void I2C_slave_writeStart(i2c_slave_t* slave);
+void I2C_slave_setPointer(i2c_slave_t* slave);
+void I2C_slave_receive(i2c_slave_t* slave);
+void I2C_slave_readStart(i2c_slave_t* slave);
+void I2C_slave_transmit(i2c_slave_t* slave);
+
+#define I2C_SLAVE "I2C_SLAVE"
+static string_data_t _MODULE_I2C_SLAVE = {I2C_SLAVE, sizeof (I2C_SLAVE)};
+
+/// Module of the slaves
+hModule_t i2c_slave_module = INVALID_MODULE_HANDLE;
+
+/*****************************************************************************/
+/* Communication Functions                                                   */
+/*****************************************************************************/
+/**
+ * Notify the registers written from the master
+ * @param argc unused
+ * @param argv context of the slave in argv[0]
+ */
+void serviceI2C_slave(int argc, event_arg_t* argv) {
+    i2c_slave_t* slave = (i2c_slave_t*) argv[0];
+    unsigned char first;
+    unsigned int size;
+    critical_t section;
+    CRITICAL_ENTER(section, I2C_SLAVE_IPL);
+    first = slave->first;
+    size = slave->size;
+    slave->written = false;
+    CRITICAL_EXIT(section);
+    if (slave->pWrite != NULL) {
+        slave->pWrite(slave, first, size);
+    }
+}
+
+hEvent_t I2C_slave_Init(i2c_slave_t* slave, hardware_bit_t* i2c_interrupt, REGISTER i2c_con, REGISTER i2c_stat, REGISTER i2c_add, REGISTER i2c_trn, REGISTER i2c_rcv, unsigned char address) {
+    slave->INTERRUPT = i2c_interrupt;
+    slave->CON = i2c_con;
+    slave->STAT = i2c_stat;
+    slave->ADD = i2c_add;
+    slave->TRN = i2c_trn;
+    slave->RCV = i2c_rcv;
+    slave->arg = (event_arg_t) slave;
+    slave->state = &I2C_slave_idle;
+    slave->regions = NULL;
+    slave->regions_len = 0;
+    slave->region = NULL;
+    slave->pointer = 0;
+    slave->pRead = NULL;
+    slave->pWrite = NULL;
+    slave->written = false;
+    memset(&slave->stats, 0, sizeof(i2c_slave_stats_t));
+    if (i2c_slave_module == INVALID_MODULE_HANDLE) {
+        /// Register module
+        i2c_slave_module = register_module(&_MODULE_I2C_SLAVE);
+    }
+    /// Register event
+    slave->service = register_event_p(i2c_slave_module, &serviceI2C_slave, EVENT_PRIORITY_LOW);
+    /// 7 bit address, clock stretching only on transmission
+    *slave->CON = 0x0000;
+    *slave->STAT = 0x0000;
+    *slave->ADD = address & 0x7F;
+    /// Set low interrupt
+    REGISTER_MASK_SET_LOW(slave->INTERRUPT->REG, slave->INTERRUPT->CS_mask);
+    REGISTER_MASK_SET_HIGH(slave->CON, MASK_I2CCON_EN);
+    return slave->service;
+}
+
+void I2C_slave_map(i2c_slave_t* slave, const i2c_slave_region_t* regions, unsigned char len, I2C_slaveReadFunc pRead, I2C_slaveWriteFunc pWrite) {
+    slave->state = &I2C_slave_idle;
+    slave->regions = regions;
+    slave->regions_len = len;
+    slave->region = NULL;
+    slave->pRead = pRead;
+    slave->pWrite = pWrite;
+}
+
+void I2C_slave_getStats(i2c_slave_t* slave, i2c_slave_stats_t* stats) {
+    *stats = slave->stats;
+}
+
+inline void I2C_slave_manager(i2c_slave_t* slave) {
+    if (REGISTER_MASK_READ(slave->STAT, MASK_I2CSTAT_I2COV)) {
+        slave->stats.overflows++;
+        REGISTER_MASK_SET_LOW(slave->STAT, MASK_I2CSTAT_I2COV);
+    }
+    // The address byte starts a new transaction
+    if (REGISTER_MASK_READ(slave->STAT, MASK_I2CSTAT_D_A) == 0) {
+        if (REGISTER_MASK_READ(slave->STAT, MASK_I2CSTAT_R_W)) {
+            slave->state = &I2C_slave_readStart;
+        } else {
+            slave->state = &I2C_slave_writeStart;
+        }
+    }
+    (* slave->state) (slave); // execute the service routine
+    return;
+}
+/**
+ * Find the region of a register
+ * @param slave context of the slave
+ * @param reg the register
+ * @return the region, NULL if the register is unmapped
+ */
+static const i2c_slave_region_t* I2C_slave_find(i2c_slave_t* slave, unsigned char reg) {
+    unsigned char i;
+    for (i = 0; i < slave->regions_len; ++i) {
+        if (reg >= slave->regions[i].reg
+                && (unsigned char) (reg - slave->regions[i].reg) < slave->regions[i].size) {
+            return &slave->regions[i];
+        }
+    }
+    return NULL;
+}
+/**
+ * Move the pointer on the next register
+ */
+static inline void I2C_slave_next(i2c_slave_t* slave) {
+    slave->pointer++;
+    if (slave->region == NULL
+            || (unsigned char) (slave->pointer - slave->region->reg) >= slave->region->size) {
+        slave->region = I2C_slave_find(slave, slave->pointer);
+    }
+}
+/**
+ * Add a register in the range to notify, the range grows to cover all
+ * registers written from the last notification
+ * @param slave context of the slave
+ * @param reg register written
+ */
+static inline void I2C_slave_written(i2c_slave_t* slave, unsigned char reg) {
+    unsigned char last;
+    if (slave->written == false) {
+        slave->first = reg;
+        slave->size = 1;
+        slave->written = true;
+        trigger_event_data(slave->service, 1, &slave->arg);
+        return;
+    }
+    last = slave->first + slave->size - 1;
+    if (reg < slave->first) {
+        slave->first = reg;
+    } else if (reg > last) {
+        last = reg;
+    }
+    // All 256 registers overflow a byte
+    slave->size = (unsigned int) last - slave->first + 1;
+}
+/**
+ * Idle operation
+ */
+void I2C_slave_idle(i2c_slave_t* slave) {
+    return;
+}
+
+/* WRITE FUNCTIONS */
+
+/**
+ * The master starts a write, the first byte is the register pointer
+ */
+void I2C_slave_writeStart(i2c_slave_t* slave) {
+    (void) *slave->RCV;
+    slave->stats.writes++;
+    slave->state = &I2C_slave_setPointer;
+    return;
+}
+/**
+ * Store the register pointer
+ */
+void I2C_slave_setPointer(i2c_slave_t* slave) {
+    slave->pointer = *slave->RCV;
+    slave->stats.bytes_rx++;
+    slave->region = I2C_slave_find(slave, slave->pointer);
+    slave->state = &I2C_slave_receive;
+    return;
+}
+/**
+ * Write the byte in the register
+ */
+void I2C_slave_receive(i2c_slave_t* slave) {
+    unsigned char value = *slave->RCV;
+    slave->stats.bytes_rx++;
+    if (slave->region != NULL && (slave->region->flags & I2C_SLAVE_WRITABLE)) {
+        slave->region->data[slave->pointer - slave->region->reg] = value;
+        I2C_slave_written(slave, slave->pointer);
+    } else {
+        slave->stats.rejected++;
+    }
+    I2C_slave_next(slave);
+    return;
+}
+
+/* READ FUNCTIONS */
+
+/**
+ * Send the register and release the clock
+ */
+static inline void I2C_slave_send(i2c_slave_t* slave) {
+    if (slave->region != NULL) {
+        *(slave->TRN) = slave->region->data[slave->pointer - slave->region->reg];
+    } else {
+        *(slave->TRN) = I2C_SLAVE_UNMAPPED;
+    }
+    slave->stats.bytes_tx++;
+    I2C_slave_next(slave);
+    REGISTER_MASK_SET_HIGH(slave->CON, MASK_I2CCON_SCLREL);
+}
+/**
+ * The master starts a read from the register pointer
+ */
+void I2C_slave_readStart(i2c_slave_t* slave) {
+    (void) *slave->RCV;
+    slave->stats.reads++;
+    slave->region = I2C_slave_find(slave, slave->pointer);
+    if (slave->pRead != NULL) {
+        slave->pRead(slave, slave->pointer);
+    }
+    slave->state = &I2C_slave_transmit;
+    I2C_slave_send(slave);
+    return;
+}
+/**
+ * Send the next register, until the master does not acknowledge
+ */
+void I2C_slave_transmit(i2c_slave_t* slave) {
+    if (REGISTER_MASK_READ(slave->STAT, MASK_I2CSTAT_ACKSTAT)) {
+        // End of the read
+        slave->state = &I2C_slave_idle;
+        return;
+    }
+    I2C_slave_send(slave);
+    return;
+}
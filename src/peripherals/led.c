@@ -28,30 +28,53 @@
 #define LED "LED"
 static string_data_t _MODULE_LED = {LED, sizeof (LED)};
 
-/// If led effect running
-bool led_effect = false;
-/// If first launch of effect
-bool first = true;
 /// Frequency to esecution
 frequency_t freq_cqu;
+/// Number of controller calls for each pattern slot
+unsigned int led_slot_ticks = 1;
+/// Calls left to the next slot
+unsigned int led_prescaler = 1;
+/// Step of the shared PWM counter each controller call
+#define LED_PWM_INCREMENT (256 / LED_PWM_STEPS)
+/// Shared PWM counter in Q8
+uint8_t led_pwm_counter = 0;
+/// If some led is dimmed or in fade, the PWM runs every call
+bool led_pwm_active = false;
+/// Gamma 2.2 correction, brightness / 4 to PWM duty in Q8
+static const uint8_t led_gamma[64] = {
+      0,   0,   0,   0,   1,   1,   1,   2,   3,   4,   4,   5,   7,   8,   9,  11,
+     13,  14,  16,  18,  20,  23,  25,  28,  31,  33,  36,  40,  43,  46,  50,  54,
+     57,  61,  66,  70,  74,  79,  84,  89,  94,  99, 105, 110, 116, 122, 128, 134,
+    140, 147, 153, 160, 167, 174, 182, 189, 197, 205, 213, 221, 229, 238, 246, 255,
+};
 /// Led event handle
 static hEvent_t LED_service_handle = INVALID_EVENT_HANDLE;
 /// Led task handle
 static hTask_t LED_task_handle = INVALID_TASK_HANDLE;
+
+const led_pattern_t LED_PATTERN_HEARTBEAT = {0x00000005, LED_PATTERN_SLOTS};
+const led_pattern_t LED_PATTERN_SOS = {0x05477715, 2 * LED_PATTERN_SLOTS};
 /*****************************************************************************/
 /* Communication Functions                                                   */
 /*****************************************************************************/
 
-void serviceLED(int argc, int* argv) {
+void serviceLED(int argc, event_arg_t* argv) {
     LED_blinkController((led_control_t*) argv[0], (size_t) argv[1]);
 }
 
 hEvent_t LED_Init(uint16_t freq, led_control_t* led_controller, size_t len) {
     int i;
     freq_cqu = freq;
+    led_slot_ticks = freq_cqu / LED_PATTERN_SLOTS;
+    if (led_slot_ticks == 0) {
+        led_slot_ticks = 1;
+    }
+    led_prescaler = 1;
     for (i = 0; i < len; ++i) {
-        led_controller[i].wait = 0;
         gpio_register(&led_controller[i].gpio);
+        memset(led_controller[i].status, 0, sizeof(led_controller[i].status));
+        led_controller[i].show = LED_PRIORITY_BASE;
+        LED_setBrightness(led_controller, i, LED_BRIGHTNESS_MAX);
         LED_updateBlink(led_controller, i, LED_OFF);
     }
     /// Register module
@@ -59,90 +82,295 @@ hEvent_t LED_Init(uint16_t freq, led_control_t* led_controller, size_t len) {
     /// Register event
     LED_service_handle = register_event_p(led_module, &serviceLED, EVENT_PRIORITY_LOW);
     
-    LED_task_handle = task_load_data(LED_service_handle, freq_cqu, 2, led_controller, len);
+    LED_task_handle = task_load_data(LED_service_handle, freq_cqu, 2, (event_arg_t) led_controller, (event_arg_t) len);
     /// Run task controller
     task_set(LED_task_handle, RUN);
     
     return LED_service_handle;
 }
+/**
+ * Load a pattern in the led and restart it from the first slot
+ * @param led led to update
+ * @param bits sequence of slots
+ * @param length number of slots
+ */
+static void LED_loadPattern(led_control_t* led, uint32_t bits, uint8_t length) {
+    led->pattern = bits;
+    led->length = length;
+    led->shift = bits;
+    led->remaining = length;
+}
 
-void LED_updateBlink(led_control_t* led_controller, short num, short blink) {
-    led_controller[num].number_blink = blink;
-    switch (led_controller[num].number_blink) {
+/**
+ * Tc -> LED_PATTERN_SLOTS = 1sec
+ * !       Tc/2        !   Tc/2       !
+ * !     !_____   _____!              !
+ * !     !|   |   |   |!              !
+ * !-----!|   |---|   |! . . . -------!
+ * !     !             !              !
+ * !                   !              !
+ * Each half period of a blink is LED_PATTERN_SLOTS / (2 * blink) slots
+ */
+static uint32_t LED_blinkPattern(short blink) {
+    uint32_t bits = 0;
+    uint32_t bit = 1;
+    unsigned int slot;
+    for (slot = 0; slot < LED_PATTERN_SLOTS; ++slot) {
+        // Odd half periods are high
+        if (((slot * 2 * blink) / LED_PATTERN_SLOTS) & 1) {
+            bits |= bit;
+        }
+        bit <<= 1;
+    }
+    return bits;
+}
+
+/**
+ * State of the led in the slot of the pattern and in the PWM period
+ * @param led led to check
+ * @param pwm shared PWM counter
+ * @return true if the led is on
+ */
+static inline bool LED_pwmState(led_control_t* led, uint8_t pwm) {
+    return (led->shift & 1) && pwm < led->duty;
+}
+/**
+ * Show the active status with the highest priority. The pattern restarts
+ * only if the status to show is changed or updated.
+ * @param led led to update
+ * @param updated priority of the updated status
+ */
+static void LED_arbitrate(led_control_t* led, led_priority_t updated) {
+    short priority = LED_PRIORITY_LEVELS - 1;
+    led_status_t* status;
+    while (priority > LED_PRIORITY_BASE && !led->status[priority].active) {
+        priority--;
+    }
+    if (priority == led->show && priority != updated) {
+        return;
+    }
+    status = &led->status[priority];
+    led->show = priority;
+    led->number_blink = status->number_blink;
+    LED_loadPattern(led, status->bits, status->length);
+    // Update the led without wait the next slot, with its brightness
+    if (LED_pwmState(led, led_pwm_counter)) {
+        REGISTER_MASK_SET_HIGH(led->gpio.CS_PORT, led->gpio.CS_mask);
+    } else {
+        REGISTER_MASK_SET_LOW(led->gpio.CS_PORT, led->gpio.CS_mask);
+    }
+}
+/**
+ * Store a status in the led and show it if has the highest priority
+ * @param led led to update
+ * @param priority priority of the status
+ * @param blink number of blink or LED_PATTERN
+ * @param bits sequence of slots
+ * @param length number of slots
+ * @param cycles number of pattern cycles to show, LED_FOREVER to never expire
+ */
+static void LED_loadStatus(led_control_t* led, led_priority_t priority, short blink, uint32_t bits, uint8_t length, uint16_t cycles) {
+    led_status_t* status = &led->status[priority];
+    status->number_blink = blink;
+    status->bits = bits;
+    status->length = length;
+    status->cycles = cycles;
+    status->active = true;
+    LED_arbitrate(led, priority);
+}
+
+void LED_pushBlink(led_control_t* led_controller, short num, short blink, led_priority_t priority, uint16_t cycles) {
+    switch (blink) {
         case LED_OFF:
-            //Clear bit - Set to 0
-            REGISTER_MASK_SET_LOW(led_controller[num].gpio.CS_PORT, led_controller[num].gpio.CS_mask);
+            LED_loadStatus(&led_controller[num], priority, blink, 0, LED_PATTERN_SLOTS, cycles);
             break;
         case LED_ALWAYS_HIGH:
-            //Set bit - Set to 1
-            REGISTER_MASK_SET_HIGH(led_controller[num].gpio.CS_PORT, led_controller[num].gpio.CS_mask);
+            LED_loadStatus(&led_controller[num], priority, blink, (1UL << LED_PATTERN_SLOTS) - 1, LED_PATTERN_SLOTS, cycles);
             break;
         default:
-            led_controller[num].fr_blink = freq_cqu / (2 * led_controller[num].number_blink);
+            // LED_PATTERN and the other negative values are not blink codes
+            if (blink < LED_OFF) {
+                return;
+            }
+            if (blink > LED_PATTERN_MAX_BLINK) {
+                blink = LED_PATTERN_MAX_BLINK;
+            }
+            LED_loadStatus(&led_controller[num], priority, blink, LED_blinkPattern(blink), LED_PATTERN_CYCLE, cycles);
             break;
     }
-    led_controller[num].counter = 0;
 }
 
+void LED_pushPattern(led_control_t* led_controller, short num, const led_pattern_t* pattern, led_priority_t priority, uint16_t cycles) {
+    LED_loadStatus(&led_controller[num], priority, LED_PATTERN, pattern->bits, pattern->length, cycles);
+}
+
+void LED_clearStatus(led_control_t* led_controller, short num, led_priority_t priority) {
+    if (priority == LED_PRIORITY_BASE) {
+        LED_pushBlink(led_controller, num, LED_OFF, LED_PRIORITY_BASE, LED_FOREVER);
+    } else if (led_controller[num].status[priority].active) {
+        led_controller[num].status[priority].active = false;
+        LED_arbitrate(&led_controller[num], priority);
+    }
+}
+
+void LED_updateBlink(led_control_t* led_controller, short num, short blink) {
+    LED_pushBlink(led_controller, num, blink, LED_PRIORITY_BASE, LED_FOREVER);
+}
+
+void LED_updatePattern(led_control_t* led_controller, short num, const led_pattern_t* pattern) {
+    LED_pushPattern(led_controller, num, pattern, LED_PRIORITY_BASE, LED_FOREVER);
+}
+
+void LED_setBrightness(led_control_t* led_controller, short num, uint8_t brightness) {
+    led_controller[num].step = 0;
+    led_controller[num].fraction = 0;
+    led_controller[num].breath = false;
+    led_controller[num].brightness = brightness;
+    led_controller[num].target = brightness;
+    led_controller[num].duty = led_gamma[brightness >> 2];
+    led_pwm_active = true;
+}
 /**
- * Tc -> counter = 1sec = 1000 interrupts
- * !       Tc/2        !   Tc/2       !
- * !     !_____   _____!              !
- * !     !|   |   |   |!              !
- * !-----!|   |---|   |! . . . -------!
- * !     !             !              !
- * ! WAIT   Tc/2-WAIT  !   Tc/2       !
+ * Brightness step for a fade, evaluated only when the fade starts. The
+ * step keeps a fraction of brightness, fades longer than 255 PWM periods
+ * move the led less than once a period.
+ * @param diff brightness to cover
+ * @param time duration of the fade in [mS]
+ * @return step each PWM period in Q8, at least 1
  */
+static uint16_t LED_fadeStepSize(uint8_t diff, uint16_t time) {
+    uint32_t periods = ((uint32_t) time * freq_cqu) / (1000UL * LED_PWM_STEPS);
+    uint32_t step;
+    if (periods == 0) {
+        return (uint16_t) diff << 8;
+    }
+    step = (((uint32_t) diff << 8) + periods / 2) / periods;
+    return (step > 0) ? step : 1;
+}
+
+void LED_fade(led_control_t* led_controller, short num, uint8_t brightness, uint16_t time) {
+    uint8_t diff = (brightness > led_controller[num].brightness) ?
+            brightness - led_controller[num].brightness : led_controller[num].brightness - brightness;
+    led_controller[num].breath = false;
+    led_controller[num].target = brightness;
+    led_controller[num].step = (diff > 0) ? LED_fadeStepSize(diff, time) : 0;
+    led_controller[num].fraction = 0;
+    led_pwm_active = true;
+}
+
+void LED_breath(led_control_t* led_controller, short num, uint16_t period) {
+    led_controller[num].breath = true;
+    led_controller[num].target = (led_controller[num].brightness > LED_BRIGHTNESS_MAX / 2) ? 0 : LED_BRIGHTNESS_MAX;
+    led_controller[num].step = LED_fadeStepSize(LED_BRIGHTNESS_MAX, period / 2);
+    led_controller[num].fraction = 0;
+    led_pwm_active = true;
+}
+/**
+ * Move the brightness of a step to the target, at the end of a PWM period.
+ * The integer part of the step and of the fraction left moves the led.
+ * @param led led to update
+ */
+static inline void LED_fadeUpdate(led_control_t* led) {
+    uint16_t sum = led->fraction + led->step;
+    uint8_t move = sum >> 8;
+    led->fraction = sum & 0xFF;
+    if (move == 0) {
+        return;
+    }
+    if (led->brightness < led->target) {
+        led->brightness = (led->target - led->brightness > move) ? led->brightness + move : led->target;
+    } else {
+        led->brightness = (led->brightness - led->target > move) ? led->brightness - move : led->target;
+    }
+    led->duty = led_gamma[led->brightness >> 2];
+    if (led->brightness == led->target) {
+        if (led->breath) {
+            led->target = (led->target == 0) ? LED_BRIGHTNESS_MAX : 0;
+        } else {
+            led->step = 0;
+        }
+    }
+}
 
 inline void LED_blinkController(led_control_t *led, size_t len) {
+    REGISTER port;
+    unsigned int mask = 0;
+    unsigned int value = 0;
+    uint8_t pwm = led_pwm_counter;
+    bool slot, period;
+    bool pwm_active = false;
     short i;
+    // Shared PWM tick for all leds
+    led_pwm_counter += LED_PWM_INCREMENT;
+    period = (led_pwm_counter == 0);
+    slot = (--led_prescaler == 0);
+    if (slot) {
+        led_prescaler = led_slot_ticks;
+    } else if (!led_pwm_active) {
+        // Nothing to do until the next slot
+        return;
+    }
+    if (len == 0) {
+        return;
+    }
+    port = led[0].gpio.CS_PORT;
     for(i = 0; i < len; ++i) {
-        if (led[i].number_blink > LED_OFF) {
-            if (led[i].counter > led[i].wait && led[i].counter < freq_cqu) {
-                if (led[i].counter % led[i].fr_blink == 0) {
-                    //Toggle bit
-                    REGISTER_MASK_TOGGLE(led[i].gpio.CS_PORT, led[i].gpio.CS_mask);
-                }
-                led[i].counter++;
-            } else if (led[i].counter >= 3 * freq_cqu / 2) {
-                led[i].counter = 0;
+        if (led[i].gpio.CS_PORT != port) {
+            // Flush the previous port
+            REGISTER_MASK_WRITE(port, mask, value);
+            port = led[i].gpio.CS_PORT;
+            mask = 0;
+            value = 0;
+        }
+        if (slot && --led[i].remaining == 0) {
+            led_status_t* status = &led[i].status[led[i].show];
+            if (status->cycles > 0 && --status->cycles == 0) {
+                // Status expired, restore the lower one
+                status->active = false;
+                LED_arbitrate(&led[i], led[i].show);
             } else {
-                //Clear bit - Set to 0
-                REGISTER_MASK_SET_LOW(led[i].gpio.CS_PORT, led[i].gpio.CS_mask);
-                led[i].counter++;
+                led[i].shift = led[i].pattern;
+                led[i].remaining = led[i].length;
             }
+        } else if (slot) {
+            led[i].shift >>= 1;
+        }
+        if (period && led[i].step > 0) {
+            LED_fadeUpdate(&led[i]);
+        }
+        mask |= led[i].gpio.CS_mask;
+        if (LED_pwmState(&led[i], pwm)) {
+            value |= led[i].gpio.CS_mask;
+        }
+        if (led[i].duty != LED_BRIGHTNESS_MAX || led[i].step > 0) {
+            pwm_active = true;
         }
     }
+    REGISTER_MASK_WRITE(port, mask, value);
+    led_pwm_active = pwm_active;
 }
 
-void LED_blinkFlush(led_control_t* led_controller, short* load_blink, size_t len) {
+void LED_blinkFlush(led_control_t* led_controller, size_t len) {
     int i;
+    uint32_t width, pulse;
+    if (len == 0) {
+        return;
+    }
+    width = LED_PATTERN_SLOTS / len;
+    if (width == 0) {
+        width = 1;
+    }
+    pulse = (1UL << width) - 1;
     for (i = 0; i < len; ++i) {
-        led_controller[i].wait = i * ((float) freq_cqu / len);
-        load_blink[i] = led_controller[i].number_blink;
-        LED_updateBlink(led_controller, i, 1);
+        // One pulse each led, shifted along the first second
+        LED_loadStatus(&led_controller[i], LED_PRIORITY_EFFECT, LED_PATTERN,
+                pulse << ((i * LED_PATTERN_SLOTS) / len), LED_PATTERN_CYCLE, LED_FOREVER);
     }
-    led_effect = true;
 }
 
-void LED_effectStop(led_control_t* led_controller, short* load_blink, size_t len) {
+void LED_effectStop(led_control_t* led_controller, size_t len) {
     int i;
-    int value = 0;
-    if (led_effect) {
-        for (i = 0; i < len; ++i) {
-            value += led_controller[i].counter;
-        }
-        if (value == 0) {
-            if (~first) {
-                for (i = 0; i < len; ++i) {
-                    LED_updateBlink(led_controller, i, load_blink[i]);
-                    led_controller[i].wait = 0;
-                }
-                led_effect = false;
-                first = true;
-            } else {
-                first = false;
-            }
-        }
+    for (i = 0; i < len; ++i) {
+        LED_clearStatus(led_controller, i, LED_PRIORITY_EFFECT);
     }
 }
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+ */
+
+/******************************************************************************/
+/* Files to Include                                                           */
+/******************************************************************************/
+
+#include <xc.h>
+#include <string.h>
+
+#include "system/cpu_load.h"
+#include "system/critical.h"
+
+/******************************************************************************/
+/* Global Variable Declaration                                                */
+/******************************************************************************/
+
+/// Timer of the kernel tick and its period
+REGISTER load_timer = NULL;
+unsigned int load_period;
+/// Timer at the last measure
+unsigned int load_last;
+/// Levels in progress, the idle level at the bottom
+uint8_t load_stack[LNG_CPU_LOAD + 1];
+uint8_t load_depth = 0;
+/// Levels ignored over the top of the stack, still to exit, and all of them
+uint8_t load_dropped = 0;
+uint16_t load_overflows = 0;
+/// Timer counts of each level in the current window
+uint32_t load_counts[LNG_CPU_LOAD];
+/// Ticks in a window and ticks left
+uint16_t load_window_ticks, load_ticks_left;
+/// Timer counts of the last windows, the most recent at load_newest
+uint32_t load_history[CPU_LOAD_WINDOWS][LNG_CPU_LOAD];
+uint8_t load_newest = 0;
+uint8_t load_windows = 0;
+
+/*****************************************************************************/
+/* Communication Functions                                                   */
+/*****************************************************************************/
+
+void cpu_load_init(REGISTER timer_register, REGISTER pr_timer, frequency_t frequency) {
+    load_timer = NULL;
+    load_period = (*pr_timer) + 1;
+    load_window_ticks = frequency;
+    load_ticks_left = frequency;
+    memset(load_counts, 0, sizeof(load_counts));
+    memset(load_history, 0, sizeof(load_history));
+    load_newest = 0;
+    load_windows = 0;
+    load_depth = 0;
+    load_dropped = 0;
+    load_overflows = 0;
+    load_stack[0] = CPU_LOAD_IDLE;
+    load_last = *timer_register;
+    load_timer = timer_register;
+}
+/**
+ * Add the time from the last measure to the level in progress
+ */
+static inline void cpu_load_measure(void) {
+    unsigned int now = *load_timer;
+    unsigned int elapsed = (now >= load_last) ? now - load_last : now + load_period - load_last;
+    load_counts[load_stack[load_depth]] += elapsed;
+    load_last = now;
+}
+
+inline void cpu_load_enter(unsigned int level) {
+    critical_t section;
+    if (load_timer == NULL) {
+        return;
+    }
+    // Not measured, the section is on the path of every event and tick
+    critical_enter(&section, NULL, CRITICAL_ALL);
+    cpu_load_measure();
+    if (load_depth < LNG_CPU_LOAD && level < LNG_CPU_LOAD) {
+        load_stack[++load_depth] = level;
+    } else {
+        // The time stays on the level in progress, the exit is ignored too
+        load_dropped++;
+        load_overflows++;
+    }
+    critical_exit(&section);
+}
+
+inline void cpu_load_exit(void) {
+    critical_t section;
+    if (load_timer == NULL) {
+        return;
+    }
+    critical_enter(&section, NULL, CRITICAL_ALL);
+    cpu_load_measure();
+    if (load_dropped > 0) {
+        load_dropped--;
+    } else if (load_depth > 0) {
+        load_depth--;
+    }
+    critical_exit(&section);
+}
+
+inline void cpu_load_tick(void) {
+    uint8_t next;
+    uint32_t* counts;
+    unsigned int level;
+    critical_t section;
+    if (load_timer == NULL || --load_ticks_left > 0) {
+        return;
+    }
+    load_ticks_left = load_window_ticks;
+    next = (load_newest + 1) % CPU_LOAD_WINDOWS;
+    counts = load_history[next];
+    critical_enter(&section, NULL, CRITICAL_ALL);
+    cpu_load_measure();
+    // Only the counts in the tick, the reader computes the load
+    for (level = 0; level < LNG_CPU_LOAD; ++level) {
+        counts[level] = load_counts[level];
+        load_counts[level] = 0;
+    }
+    load_newest = next;
+    if (load_windows < CPU_LOAD_WINDOWS) {
+        load_windows++;
+    }
+    critical_exit(&section);
+}
+
+void cpu_load_get(cpu_load_window_t window, uint16_t* load) {
+    uint64_t counts[LNG_CPU_LOAD];
+    uint64_t total = 0;
+    unsigned int level, i, windows;
+    critical_t section;
+    memset(counts, 0, sizeof(counts));
+    // The tick can overwrite the oldest window during the sum
+    CRITICAL_ENTER(section, CRITICAL_ALL);
+    windows = (window == CPU_LOAD_1S || load_windows == 0) ? 1 : load_windows;
+    for (i = 0; i < windows; ++i) {
+        for (level = 0; level < LNG_CPU_LOAD; ++level) {
+            counts[level] += load_history[(load_newest + CPU_LOAD_WINDOWS - i) % CPU_LOAD_WINDOWS][level];
+        }
+    }
+    CRITICAL_EXIT(section);
+    for (level = 0; level < LNG_CPU_LOAD; ++level) {
+        total += counts[level];
+    }
+    for (level = 0; level < LNG_CPU_LOAD; ++level) {
+        load[level] = (total > 0) ? (counts[level] * CPU_LOAD_FULL) / total : 0;
+    }
+}
+
+uint16_t cpu_load_overflows(void) {
+    return load_overflows;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+ */
+
+/******************************************************************************/
+/* Files to Include                                                           */
+/******************************************************************************/
+
+#include <xc.h>
+
+#include "system/critical.h"
+#include "system/task_manager.h"
+
+/******************************************************************************/
+/* Global Variable Declaration                                                */
+/******************************************************************************/
+
+/// Timer of the kernel tick and its period register
+REGISTER critical_timer = NULL;
+REGISTER critical_pr = NULL;
+/// Sites run at least once, they stay in the list
+critical_site_t* critical_list = NULL;
+
+/*****************************************************************************/
+/* Communication Functions                                                   */
+/*****************************************************************************/
+
+void critical_init(REGISTER timer_register, REGISTER pr_timer) {
+    critical_timer = NULL;
+    critical_reset_stats();
+    critical_pr = pr_timer;
+    critical_timer = timer_register;
+}
+
+inline void critical_enter(critical_t* section, critical_site_t* site, unsigned int ceiling) {
+    // An interrupt between the read and the raise returns on the same priority
+    int save_to = SRbits.IPL;
+    if ((int) ceiling > save_to) {
+        SET_CPU_IPL(ceiling);
+    }
+    section->save = save_to;
+    section->site = site;
+    if (critical_timer != NULL && site != NULL) {
+        // The tick can be over the ceiling, the ticks and the timer are
+        // read again after a tick in the middle
+        do {
+            section->ticks = task_get_ticks();
+            section->timer = *critical_timer;
+        } while (section->ticks != task_get_ticks());
+    }
+}
+
+inline void critical_exit(critical_t* section) {
+    critical_site_t* site = section->site;
+    int32_t elapsed;
+    if (critical_timer != NULL && site != NULL) {
+        SET_CPU_IPL(CRITICAL_ALL);
+        // A tick waiting for the ISR is a period short
+        elapsed = (int32_t) (task_get_ticks() - section->ticks) * ((*critical_pr) + 1)
+                + (int32_t) (*critical_timer) - (int32_t) section->timer;
+        if (elapsed < 0) {
+            elapsed += (*critical_pr) + 1;
+        }
+        site->count++;
+        if ((uint32_t) elapsed > site->max) {
+            site->max = elapsed;
+        }
+        if (!site->linked) {
+            site->next = critical_list;
+            critical_list = site;
+            site->linked = true;
+        }
+    }
+    RESTORE_CPU_IPL(section->save);
+}
+
+critical_site_t* critical_sites(void) {
+    return critical_list;
+}
+
+void critical_reset_stats(void) {
+    critical_site_t* site;
+    int save_to;
+    SET_AND_SAVE_CPU_IPL(save_to, CRITICAL_ALL);
+    for (site = critical_list; site != NULL; site = site->next) {
+        site->count = 0;
+        site->max = 0;
+    }
+    RESTORE_CPU_IPL(save_to);
+}
@@ -22,10 +22,26 @@
 #include <xc.h>
 
 #include "system/events.h"
+#include "system/critical.h"
+#include "system/task_manager.h"
+#include "system/trace.h"
+#include "system/cpu_load.h"
+#include "system/snapshot.h"
 #include "peripherals/gpio.h"
 
 /// Max number of events
+#ifndef MAX_EVENTS
 #define MAX_EVENTS 16
+#endif
+#if EVENT_LEVELS < LNG_EVENTPRIORITY || EVENT_LEVELS > 32
+#error "EVENT_LEVELS from LNG_EVENTPRIORITY to 32"
+#endif
+/// Pending levels of a priority, a bit for each software level
+#if EVENT_LEVELS > 16
+typedef uint32_t event_levels_t;
+#else
+typedef uint16_t event_levels_t;
+#endif
 /**
  * Event state:
  * FALSE: The event doesn't running
@@ -44,19 +60,30 @@ typedef enum _event_type {
  * number of argument
  * arguments
  * priority
- * overflow timer
+ * software level
  * time to computation
  * Name event
+ * budget in timer counts, action and counters of the overruns
+ * counters of triggers, callbacks and time in timer counts
  */
 typedef struct _tagEVENT {
     EVENT_TYPE eventPending;
     event_callback_t event_callback;
     int argc;
-    int* argv;
+    event_arg_t* argv;
     eventPriority priority;
-    uint16_t overTmr;
+    uint8_t level;
     uint32_t time;
     hModule_t name;
+    uint32_t budget;
+    event_overrun_t action;
+    uint8_t home;
+    uint8_t skip;
+    uint8_t skip_left;
+    uint16_t overruns;
+    uint32_t triggers;
+    uint32_t runs;
+    uint64_t total;
 } EVENT;
 /**
  * Information about hardware interrupt
@@ -77,7 +104,13 @@ typedef struct _interrupt_bit {
 interrupt_bit_t interrupts[LNG_EVENTPRIORITY];
 /// Declare an array with all events
 EVENT events[MAX_EVENTS];
-/// Number of all event registered
+/// Levels with events pending for each priority
+volatile event_levels_t event_levels[LNG_EVENTPRIORITY];
+/// Hardware priorities from the lowest to the highest
+const eventPriority event_rank[LNG_EVENTPRIORITY] = {
+    EVENT_PRIORITY_VERY_LOW, EVENT_PRIORITY_LOW, EVENT_PRIORITY_MEDIUM, EVENT_PRIORITY_HIGH
+};
+/// Number of the priorities with an interrupt registered
 unsigned short event_counter = 0;
 /// Timer register
 REGISTER timer;
@@ -87,6 +120,8 @@ REGISTER PRTIMER;
 unsigned long time_sys;
 /// Maskable interrupt level
 unsigned int LEVEL;
+/// Report of the overruns
+event_overrun_hook_t overrun_hook = NULL;
 
 /******************************************************************************/
 /* Communication Functions                                                    */
@@ -99,11 +134,20 @@ void reset_event(hEvent_t eventIndex) {
     events[eventIndex].event_callback = NULL;
     events[eventIndex].eventPending = FALSE;
     events[eventIndex].priority = EVENT_PRIORITY_LOW;
-    events[eventIndex].overTmr = 0;
+    events[eventIndex].level = 0;
     events[eventIndex].time = 0;
     events[eventIndex].argc = 0;
     events[eventIndex].argv = NULL;
-    events[eventIndex].name = NULL;
+    events[eventIndex].name = INVALID_MODULE_HANDLE;
+    events[eventIndex].budget = EVENT_NO_BUDGET;
+    events[eventIndex].action = EVENT_OVERRUN_REPORT;
+    events[eventIndex].home = 0;
+    events[eventIndex].skip = 0;
+    events[eventIndex].skip_left = 0;
+    events[eventIndex].overruns = 0;
+    events[eventIndex].triggers = 0;
+    events[eventIndex].runs = 0;
+    events[eventIndex].total = 0;
 }
 
 void init_events(REGISTER timer_register, REGISTER pr_timer, frequency_t frq_mcu, unsigned int level) {
@@ -118,8 +162,10 @@ void init_events(REGISTER timer_register, REGISTER pr_timer, frequency_t frq_mcu
     }
     for (priorityIndex = 0; priorityIndex < LNG_EVENTPRIORITY; ++priorityIndex) {
         interrupts[priorityIndex].available = false;
+        event_levels[priorityIndex] = 0;
     }
     event_counter = 0;
+    overrun_hook = NULL;
 }
 
 void register_interrupt(eventPriority priority, hardware_bit_t* pin) {
@@ -133,12 +179,25 @@ void trigger_event(hEvent_t hEvent) {
     trigger_event_data(hEvent, 0, NULL);
 }
 
-void trigger_event_data(hEvent_t hEvent, int argc, int *argv) {
+void trigger_event_data(hEvent_t hEvent, int argc, event_arg_t *argv) {
+    critical_t section;
     if (hEvent < MAX_EVENTS) {
         if (events[hEvent].event_callback != NULL) {
+            // Pending flag and level together, event_manager checks both;
+            // the skips are reloaded from the priority of the event
+            CRITICAL_ENTER(section, CRITICAL_ALL);
+            if (events[hEvent].skip_left > 0) {
+                events[hEvent].skip_left--;
+                CRITICAL_EXIT(section);
+                return;
+            }
             events[hEvent].eventPending = TRUE;
             events[hEvent].argc = argc;
             events[hEvent].argv = argv;
+            event_levels[events[hEvent].priority] |= (event_levels_t) 1 << events[hEvent].level;
+            events[hEvent].triggers++;
+            CRITICAL_EXIT(section);
+            TRACE(TRACE_TRIGGER, events[hEvent].priority, hEvent);
             REGISTER_MASK_SET_HIGH(interrupts[events[hEvent].priority].interrupt_bit->REG, interrupts[events[hEvent].priority].interrupt_bit->CS_mask);
         }
     }
@@ -148,7 +207,15 @@ hEvent_t register_event(hModule_t name, event_callback_t event_callback) {
     return register_event_p(name, event_callback, EVENT_PRIORITY_MEDIUM);
 }
 
-hEvent_t register_event_p(hModule_t name, event_callback_t event_callback, eventPriority priority) {
+/**
+ * Register the event on a free slot
+ * @param name associated number module name
+ * @param event_callback function to call
+ * @param priority hardware priority
+ * @param level software level
+ * @return number event
+ */
+hEvent_t register_event_slot(hModule_t name, event_callback_t event_callback, eventPriority priority, uint8_t level) {
     hEvent_t eventIndex;
 
     if (interrupts[priority].available) {
@@ -156,6 +223,8 @@ hEvent_t register_event_p(hModule_t name, event_callback_t event_callback, event
             if (events[eventIndex].event_callback == NULL) {
                 events[eventIndex].event_callback = event_callback;
                 events[eventIndex].priority = priority;
+                events[eventIndex].level = level;
+                events[eventIndex].home = level;
                 events[eventIndex].name = name;
                 return eventIndex;
             }
@@ -164,49 +233,326 @@ hEvent_t register_event_p(hModule_t name, event_callback_t event_callback, event
     return INVALID_EVENT_HANDLE;
 }
 
+hEvent_t register_event_p(hModule_t name, event_callback_t event_callback, eventPriority priority) {
+    unsigned short rank;
+    for (rank = 0; rank < LNG_EVENTPRIORITY; ++rank) {
+        if (event_rank[rank] == priority) {
+            break;
+        }
+    }
+    return register_event_slot(name, event_callback, priority, rank * EVENT_LEVELS_PRIORITY);
+}
+
+/**
+ * Hardware priority of a software level
+ * @param level software level
+ * @return rank of the priority in event_rank, -1 without interrupts
+ */
+short event_level_rank(uint8_t level) {
+    short rank, search;
+    rank = level / EVENT_LEVELS_PRIORITY;
+    if (rank >= LNG_EVENTPRIORITY) {
+        rank = LNG_EVENTPRIORITY - 1;
+    }
+    // The group priority, else the nearest lower one, else the nearest higher
+    for (search = rank; search >= 0; --search) {
+        if (interrupts[event_rank[search]].available) {
+            return search;
+        }
+    }
+    for (search = rank + 1; search < LNG_EVENTPRIORITY; ++search) {
+        if (interrupts[event_rank[search]].available) {
+            return search;
+        }
+    }
+    return -1;
+}
+
+hEvent_t register_event_level(hModule_t name, event_callback_t event_callback, uint8_t level) {
+    short rank;
+    if (level >= EVENT_LEVELS) {
+        return INVALID_EVENT_HANDLE;
+    }
+    rank = event_level_rank(level);
+    if (rank < 0) {
+        return INVALID_EVENT_HANDLE;
+    }
+    return register_event_slot(name, event_callback, event_rank[rank], level);
+}
+
+uint8_t get_event_level(hEvent_t hEvent) {
+    if (hEvent < MAX_EVENTS && events[hEvent].event_callback != NULL) {
+        return events[hEvent].level;
+    }
+    return INVALID_EVENT_LEVEL;
+}
+
 bool unregister_event(hEvent_t eventIndex) {
-    if (event_counter <= 0 && eventIndex != INVALID_EVENT_HANDLE) {
+    critical_t section;
+    if (eventIndex < MAX_EVENTS && events[eventIndex].event_callback != NULL) {
+        // A trigger in the middle finds the slot free
+        CRITICAL_ENTER(section, CRITICAL_ALL);
         reset_event(eventIndex);
-        event_counter--;
+        CRITICAL_EXIT(section);
         return true;
     } else
         return false;
 }
 
+/**
+ * Move the event on a software level, a trigger in the middle goes on the
+ * new level
+ * @param hEvent number event
+ * @param level software level
+ */
+void event_move_level(hEvent_t hEvent, uint8_t level) {
+    critical_t section;
+    short rank = event_level_rank(level);
+    if (rank < 0) {
+        return;
+    }
+    CRITICAL_ENTER(section, CRITICAL_ALL);
+    events[hEvent].level = level;
+    events[hEvent].priority = event_rank[rank];
+    if (events[hEvent].eventPending == TRUE) {
+        event_levels[events[hEvent].priority] |= (event_levels_t) 1 << level;
+        REGISTER_MASK_SET_HIGH(interrupts[events[hEvent].priority].interrupt_bit->REG, interrupts[events[hEvent].priority].interrupt_bit->CS_mask);
+    }
+    CRITICAL_EXIT(section);
+}
+
+bool event_set_budget(hEvent_t hEvent, uint32_t budget, event_overrun_t action, uint8_t skip) {
+    if (hEvent >= MAX_EVENTS || events[hEvent].event_callback == NULL) {
+        return false;
+    }
+    // From [uS] to timer counts
+    events[hEvent].budget = ((uint64_t) budget * 1000) / time_sys;
+    if (budget != EVENT_NO_BUDGET && events[hEvent].budget == 0) {
+        events[hEvent].budget = 1;
+    }
+    events[hEvent].action = action;
+    events[hEvent].skip = skip;
+    events[hEvent].skip_left = 0;
+    events[hEvent].overruns = 0;
+    if (events[hEvent].level != events[hEvent].home) {
+        event_move_level(hEvent, events[hEvent].home);
+    }
+    return true;
+}
+
+void event_overrun_hook(event_overrun_hook_t hook) {
+    overrun_hook = hook;
+}
+
+uint16_t get_event_overruns(hEvent_t hEvent) {
+    if (hEvent < MAX_EVENTS) {
+        return events[hEvent].overruns;
+    }
+    return 0;
+}
+
+/**
+ * Apply the action of the event after a callback over its budget
+ * @param hEvent number event
+ */
+void event_overrun(hEvent_t hEvent) {
+    EVENT* pEvent = &events[hEvent];
+    if (pEvent->overruns < 0xFFFF) {
+        pEvent->overruns++;
+    }
+    switch (pEvent->action) {
+        case EVENT_OVERRUN_DEMOTE:
+            if (pEvent->level >= EVENT_LEVELS_PRIORITY) {
+                event_move_level(hEvent, pEvent->level - EVENT_LEVELS_PRIORITY);
+            }
+            break;
+        case EVENT_OVERRUN_SKIP:
+            pEvent->skip_left = pEvent->skip;
+            break;
+        default:
+            break;
+    }
+    if (overrun_hook != NULL) {
+        overrun_hook(hEvent, event_counts_us(pEvent->time));
+    }
+}
+
 hModule_t get_event_name(hEvent_t eventIndex) {
     return events[eventIndex].name;
 }
 
+hEvent_t event_next(hModule_t module, hEvent_t from) {
+    hEvent_t eventIndex;
+    for (eventIndex = from; eventIndex < MAX_EVENTS; ++eventIndex) {
+        if (events[eventIndex].event_callback != NULL && events[eventIndex].name == module) {
+            return eventIndex;
+        }
+    }
+    return INVALID_EVENT_HANDLE;
+}
+
+bool get_event_stats(hEvent_t hEvent, event_stats_t* stats) {
+    critical_t section;
+    if (hEvent >= MAX_EVENTS || events[hEvent].event_callback == NULL) {
+        return false;
+    }
+    CRITICAL_ENTER(section, CRITICAL_ALL);
+    stats->triggers = events[hEvent].triggers;
+    stats->runs = events[hEvent].runs;
+    stats->overruns = events[hEvent].overruns;
+    stats->time = events[hEvent].total;
+    CRITICAL_EXIT(section);
+    stats->time *= time_sys;
+    return true;
+}
+
+void event_snapshot(snapshot_t* snapshot) {
+    critical_t section;
+    EVENT event;
+    hEvent_t eventIndex;
+    uint16_t count = 0;
+    for (eventIndex = 0; eventIndex < MAX_EVENTS; ++eventIndex) {
+        if (events[eventIndex].event_callback != NULL) {
+            count++;
+        }
+    }
+    snapshot_section(snapshot, SNAPSHOT_EVENTS, SNAPSHOT_EVENT_SIZE, count);
+    for (eventIndex = 0; eventIndex < MAX_EVENTS && count > 0; ++eventIndex) {
+        CRITICAL_ENTER(section, CRITICAL_ALL);
+        event = events[eventIndex];
+        CRITICAL_EXIT(section);
+        if (event.event_callback == NULL) {
+            continue;
+        }
+        // A registration in the middle does not change the size of the section
+        count--;
+        snapshot_put16(snapshot, eventIndex);
+        snapshot_put16(snapshot, event.name);
+        snapshot_put8(snapshot, event.priority);
+        snapshot_put8(snapshot, event.level);
+        snapshot_put8(snapshot, event.eventPending);
+        snapshot_put8(snapshot, event.action);
+        snapshot_put32(snapshot, event.triggers);
+        snapshot_put32(snapshot, event.runs);
+        snapshot_put16(snapshot, event.overruns);
+        snapshot_put32(snapshot, event.time * time_sys);
+        snapshot_put32(snapshot, (event.total * time_sys) / 1000);
+    }
+    // An event unregistered in the middle leaves records to fill
+    snapshot_pad(snapshot, SNAPSHOT_EVENT_SIZE, count);
+}
+
+bool event_pending(void) {
+    hEvent_t eventIndex;
+    for (eventIndex = 0; eventIndex < MAX_EVENTS; ++eventIndex) {
+        if (events[eventIndex].eventPending == TRUE) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Take the highest level pending on the priority
+ * @param priority hardware priority
+ * @return level, INVALID_EVENT_LEVEL without events pending
+ */
+static inline uint8_t event_next_level(eventPriority priority) {
+    critical_t section;
+    event_levels_t pending;
+    uint8_t level = EVENT_LEVELS - 1;
+    CRITICAL_ENTER(section, CRITICAL_ALL);
+    pending = event_levels[priority];
+    if (pending == 0) {
+        CRITICAL_EXIT(section);
+        return INVALID_EVENT_LEVEL;
+    }
+    while ((pending & ((event_levels_t) 1 << level)) == 0) {
+        level--;
+    }
+    event_levels[priority] = pending & ~((event_levels_t) 1 << level);
+    CRITICAL_EXIT(section);
+    return level;
+}
+
 inline void event_manager(eventPriority priority) {
-    int save_to;
+    critical_t section;
+    cpu_load_enter(priority);
     if (event_counter > 0) {
         hEvent_t eventIndex;
         EVENT* pEvent;
-        for (eventIndex = 0; eventIndex < MAX_EVENTS; ++eventIndex) {
-            pEvent = &events[eventIndex];
-            if ((pEvent->eventPending == TRUE) && (pEvent->priority == priority)) {
-                if (pEvent->event_callback != NULL) {
-                    uint16_t time;
+        uint8_t level;
+        event_levels_t higher;
+        while ((level = event_next_level(priority)) != INVALID_EVENT_LEVEL) {
+            higher = (event_levels_t) (~0UL << level << 1);
+            for (eventIndex = 0; eventIndex < MAX_EVENTS; ++eventIndex) {
+                pEvent = &events[eventIndex];
+                if ((pEvent->eventPending == TRUE) && (pEvent->priority == priority)
+                        && (pEvent->level == level) && (pEvent->event_callback != NULL)) {
+                    event_stamp_t start;
                     pEvent->eventPending = WORKING;
-                    pEvent->overTmr = 0;                                            ///< Reset timer
-                    time = *timer;                                                  ///< Timing function
-                    SET_AND_SAVE_CPU_IPL(save_to, LEVEL);
+                    event_stamp(&start);                                            ///< Timing function
+                    CRITICAL_ENTER(section, LEVEL);
+                    TRACE(TRACE_START, priority, eventIndex);
                     pEvent->event_callback(pEvent->argc, pEvent->argv);             ///< Launch callback
-                    pEvent->eventPending = FALSE;                                   ///< Complete event
-                    RESTORE_CPU_IPL(save_to);
-                    // Time of execution
-                    if(pEvent->overTmr == 0) {                  
-                        pEvent->time = (*timer) - time;
-                    } else {
-                        pEvent->time = ((*timer) + (0xFFFF - time)
-                                + (0xFFFF * (pEvent->overTmr - 1)));
+                    TRACE(TRACE_END, priority, eventIndex);
+                    CRITICAL_EXIT(section);
+                    // Complete the event; a trigger from the callback or
+                    // from a higher interrupt keeps it pending on its level
+                    CRITICAL_ENTER(section, CRITICAL_ALL);
+                    if (pEvent->eventPending == WORKING) {
+                        pEvent->eventPending = FALSE;
+                    }
+                    CRITICAL_EXIT(section);
+                    pEvent->time = event_elapsed(&start);
+                    pEvent->total += pEvent->time;
+                    pEvent->runs++;
+                    if (pEvent->budget != EVENT_NO_BUDGET && pEvent->time > pEvent->budget) {
+                        event_overrun(eventIndex);
+                    }
+                    // A higher level triggered from the callback runs first,
+                    // the rest of this level after it
+                    if (event_levels[priority] & higher) {
+                        CRITICAL_ENTER(section, CRITICAL_ALL);
+                        event_levels[priority] |= (event_levels_t) 1 << level;
+                        CRITICAL_EXIT(section);
+                        break;
                     }
                 }
-            } else if(pEvent->eventPending == WORKING) {
-                pEvent->overTmr++;
             }
         }
     }
+    cpu_load_exit();
+}
+
+inline void event_stamp(event_stamp_t* stamp) {
+    // Read again if the tick moves between the ticks and the timer
+    do {
+        stamp->ticks = task_get_ticks();
+        stamp->counts = *timer;
+    } while (stamp->ticks != task_get_ticks());
+}
+
+inline uint32_t event_elapsed(const event_stamp_t* stamp) {
+    event_stamp_t now;
+    uint32_t period = (uint32_t) (*PRTIMER) + 1;
+    uint32_t ticks;
+    event_stamp(&now);
+    ticks = now.ticks - stamp->ticks;
+    // The kernel ticks count the periods of the timer
+    if (ticks >= UINT32_MAX / period - 1) {
+        return UINT32_MAX;
+    }
+    ticks = ticks * period + now.counts;
+    if (ticks < stamp->counts) {
+        // A tick waiting for the ISR is a period short
+        ticks += period;
+    }
+    return ticks - stamp->counts;
+}
+
+uint32_t event_counts_us(uint32_t counts) {
+    return ((uint64_t) counts * time_sys) / 1000;
 }
 
 inline uint32_t get_time(hEvent_t hEvent) {
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+ */
+
+/******************************************************************************/
+/* Files to Include                                                           */
+/******************************************************************************/
+
+#include <xc.h>
+#include <string.h>
+
+#include "system/idle.h"
+#include "system/critical.h"
+#include "system/events.h"
+#include "system/task_manager.h"
+
+/******************************************************************************/
+/* Global Variable Declaration                                                */
+/******************************************************************************/
+
+/// Timer of the kernel tick and its period
+REGISTER idle_timer = NULL;
+unsigned int idle_period;
+/// Sleep allowed without running tasks
+bool idle_sleep = false;
+idle_stats_t idle_stats;
+
+/*****************************************************************************/
+/* Communication Functions                                                   */
+/*****************************************************************************/
+
+void idle_init(REGISTER timer_register, REGISTER pr_timer, bool sleep) {
+    idle_timer = timer_register;
+    idle_period = (*pr_timer) + 1;
+    idle_sleep = sleep;
+    memset(&idle_stats, 0, sizeof(idle_stats));
+}
+
+bool idle_manager(void) {
+    unsigned int start, stop;
+    bool sleep;
+    critical_t section;
+    if (idle_timer == NULL) {
+        return false;
+    }
+    idle_stats.calls++;
+    // The interrupts wake the CPU also with priority under the CPU, they
+    // run after the restore; the power save is not a measured section
+    critical_enter(&section, NULL, CRITICAL_ALL);
+    if (event_pending()) {
+        idle_stats.busy++;
+        CRITICAL_EXIT(section);
+        return false;
+    }
+    // The sleep stops the timer of the kernel tick
+    sleep = idle_sleep && (task_next_release() == TASK_NO_RELEASE);
+    start = *idle_timer;
+    if (sleep) {
+        idle_stats.sleeps++;
+        Sleep();
+    } else {
+        Idle();
+        stop = *idle_timer;
+        stop = (stop >= start) ? stop - start : stop + idle_period - start;
+        // Carry the counts in a period without overflow of the word
+        if (stop >= idle_period - idle_stats.residency_counts) {
+            idle_stats.residency_counts -= idle_period - stop;
+            idle_stats.residency++;
+        } else {
+            idle_stats.residency_counts += stop;
+        }
+    }
+    idle_stats.wakeups++;
+    CRITICAL_EXIT(section);
+    return true;
+}
+
+void idle_get_stats(idle_stats_t* stats) {
+    critical_t section;
+    CRITICAL_ENTER(section, CRITICAL_ALL);
+    *stats = idle_stats;
+    CRITICAL_EXIT(section);
+}
+
+void idle_reset_stats(void) {
+    critical_t section;
+    CRITICAL_ENTER(section, CRITICAL_ALL);
+    memset(&idle_stats, 0, sizeof(idle_stats));
+    CRITICAL_EXIT(section);
+}
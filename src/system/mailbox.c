@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+ */
+
+/******************************************************************************/
+/* Files to Include                                                           */
+/******************************************************************************/
+
+#include <xc.h>
+#include <string.h>
+
+#include "system/mailbox.h"
+#include "system/critical.h"
+
+/*****************************************************************************/
+/* Communication Functions                                                   */
+/*****************************************************************************/
+/**
+ * Event of the mailbox, run the callback on each message in the slot, also
+ * on the ones posted during the callbacks
+ * @param argc unused
+ * @param argv mailbox in argv[0]
+ */
+void mailbox_deliver(int argc, event_arg_t* argv) {
+    mailbox_t* box = (mailbox_t*) argv[0];
+    critical_t section;
+    while (box->count > 0) {
+        // The slot stays out of the posts up to the end of the callback
+        box->callback(box->event, box->slots + (size_t) box->head * box->size);
+        CRITICAL_ENTER(section, CRITICAL_ALL);
+        box->head = (box->head + 1 < box->depth) ? box->head + 1 : 0;
+        box->count--;
+        CRITICAL_EXIT(section);
+    }
+}
+
+hEvent_t mailbox_init(mailbox_t* box, void* slots, size_t size, uint8_t depth,
+        hModule_t module, mailbox_callback_t callback, eventPriority priority) {
+    box->slots = (uint8_t*) slots;
+    box->size = size;
+    box->depth = depth;
+    box->head = 0;
+    box->count = 0;
+    box->lost = 0;
+    box->callback = callback;
+    box->arg = (event_arg_t) box;
+    box->event = INVALID_EVENT_HANDLE;
+    if (slots == NULL || size == 0 || depth == 0 || callback == NULL) {
+        return INVALID_EVENT_HANDLE;
+    }
+    box->event = register_event_p(module, &mailbox_deliver, priority);
+    return box->event;
+}
+
+bool mailbox_post(mailbox_t* box, const void* message, size_t size) {
+    critical_t section;
+    unsigned int tail;
+    if (box->event == INVALID_EVENT_HANDLE || size != box->size) {
+        return false;
+    }
+    CRITICAL_ENTER(section, CRITICAL_ALL);
+    if (box->count >= box->depth) {
+        box->lost++;
+        CRITICAL_EXIT(section);
+        return false;
+    }
+    // Sum in int, head and count up to 254 overflow a byte
+    tail = (unsigned int) box->head + box->count;
+    if (tail >= box->depth) {
+        tail -= box->depth;
+    }
+    memcpy(box->slots + (size_t) tail * box->size, message, size);
+    box->count++;
+    CRITICAL_EXIT(section);
+    trigger_event_data(box->event, 1, &box->arg);
+    return true;
+}
+
+uint8_t mailbox_count(mailbox_t* box) {
+    return box->count;
+}
+
+uint16_t mailbox_lost(mailbox_t* box) {
+    return box->lost;
+}
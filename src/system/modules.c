@@ -19,20 +19,158 @@
 /* Files to Include                                                           */
 /******************************************************************************/
 
+#include <string.h>
+
 #include "system/modules.h"
+#include "system/events.h"
+#include "system/task_manager.h"
+#include "system/snapshot.h"
+
+#if (MODULE_TABLE_SIZE & (MODULE_TABLE_SIZE - 1)) != 0 || MODULE_TABLE_SIZE <= MAX_MODULES
+#error "MODULE_TABLE_SIZE power of two over MAX_MODULES"
+#endif
+#if MAX_MODULES > 254
+#error "MAX_MODULES up to 254"
+#endif
+/**
+ * Information about module:
+ * Name registered
+ * hash of the name
+ */
+typedef struct _module {
+    string_data_t* name;
+    uint16_t hash;
+} module_t;
 
 /******************************************************************************/
 /* Global Variable Declaration                                                */
 /******************************************************************************/
+/// Declare an array with all modules
+module_t modules[MAX_MODULES];
+/// Number of modules registered
+unsigned short module_counter = 0;
+/// Hash table of the names, module + 1 in each slot, 0 for a free slot
+uint8_t module_table[MODULE_TABLE_SIZE];
 
 /******************************************************************************/
 /* Communication Functions                                                    */
 /******************************************************************************/
 
+/**
+ * FNV-1a hash of the name, folded on 16 bits
+ * @param name string up to the terminator
+ * @return hash
+ */
+static uint16_t module_hash(const char* name) {
+    uint32_t hash = 2166136261UL;
+    while (*name != '\0') {
+        hash ^= (unsigned char) *name++;
+        hash *= 16777619UL;
+    }
+    return (uint16_t) (hash ^ (hash >> 16));
+}
+/**
+ * Slot of the hash table with the name, or the free slot for it
+ * @param name string of the name
+ * @param hash hash of the name
+ * @return slot
+ */
+static unsigned short module_slot(const char* name, uint16_t hash) {
+    unsigned short slot = hash & (MODULE_TABLE_SIZE - 1);
+    module_t* module;
+    // The table is never full, a free slot ends the probe
+    while (module_table[slot] != 0) {
+        module = &modules[module_table[slot] - 1];
+        if (module->hash == hash && strcmp(module->name->string, name) == 0) {
+            break;
+        }
+        slot = (slot + 1) & (MODULE_TABLE_SIZE - 1);
+    }
+    return slot;
+}
+
 void init_modules(void) {
-    
+    module_counter = 0;
+    memset(module_table, 0, sizeof(module_table));
 }
 
 hModule_t register_module(string_data_t* name) {
-    return (hModule_t) name;
-}
\ No newline at end of file
+    uint16_t hash;
+    unsigned short slot;
+    if (name == NULL || name->string == NULL) {
+        return INVALID_MODULE_HANDLE;
+    }
+    hash = module_hash(name->string);
+    slot = module_slot(name->string, hash);
+    if (module_table[slot] != 0) {
+        return module_table[slot] - 1;
+    }
+    if (module_counter >= MAX_MODULES) {
+        return INVALID_MODULE_HANDLE;
+    }
+    modules[module_counter].name = name;
+    modules[module_counter].hash = hash;
+    module_table[slot] = ++module_counter;
+    return module_counter - 1;
+}
+
+hModule_t module_find(const char* name) {
+    unsigned short slot;
+    if (name == NULL) {
+        return INVALID_MODULE_HANDLE;
+    }
+    slot = module_slot(name, module_hash(name));
+    return (module_table[slot] != 0) ? module_table[slot] - 1 : INVALID_MODULE_HANDLE;
+}
+
+const string_data_t* module_get_name(hModule_t module) {
+    return (module < module_counter) ? modules[module].name : NULL;
+}
+
+unsigned short get_module_number(void) {
+    return module_counter;
+}
+
+void module_snapshot(snapshot_t* snapshot) {
+    hModule_t module;
+    const char* name;
+    unsigned short i;
+    snapshot_section(snapshot, SNAPSHOT_MODULES, SNAPSHOT_MODULE_SIZE, module_counter);
+    for (module = 0; module < module_counter; ++module) {
+        snapshot_put16(snapshot, module);
+        snapshot_put16(snapshot, modules[module].hash);
+        // Name cut and padded with zeros
+        name = modules[module].name->string;
+        for (i = 0; i < SNAPSHOT_NAME_SIZE; ++i) {
+            snapshot_put8(snapshot, *name);
+            if (*name != '\0') {
+                name++;
+            }
+        }
+    }
+}
+
+bool module_get_stats(hModule_t module, module_stats_t* stats) {
+    event_stats_t event;
+    hEvent_t eventIndex;
+    hTask_t taskIndex;
+    if (module >= module_counter) {
+        return false;
+    }
+    memset(stats, 0, sizeof(module_stats_t));
+    for (eventIndex = event_next(module, 0); eventIndex != INVALID_EVENT_HANDLE;
+            eventIndex = event_next(module, eventIndex + 1)) {
+        if (get_event_stats(eventIndex, &event)) {
+            stats->events++;
+            stats->triggers += event.triggers;
+            stats->runs += event.runs;
+            stats->overruns += event.overruns;
+            stats->time += event.time;
+        }
+    }
+    for (taskIndex = task_next(module, 0); taskIndex != INVALID_TASK_HANDLE;
+            taskIndex = task_next(module, taskIndex + 1)) {
+        stats->tasks++;
+    }
+    return true;
+}
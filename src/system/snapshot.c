@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+ */
+
+/******************************************************************************/
+/* Files to Include                                                           */
+/******************************************************************************/
+
+#include <xc.h>
+
+#include "system/snapshot.h"
+#include "system/events.h"
+#include "system/task_manager.h"
+#include "system/modules.h"
+
+/// Source of a section with its context
+typedef struct _snapshot_entry {
+    snapshot_source_t source;
+    void* context;
+} snapshot_entry_t;
+
+/******************************************************************************/
+/* Global Variable Declaration                                                */
+/******************************************************************************/
+
+snapshot_entry_t snapshot_sources[SNAPSHOT_SOURCES];
+unsigned short snapshot_counter = 0;
+
+/*****************************************************************************/
+/* Communication Functions                                                   */
+/*****************************************************************************/
+
+void snapshot_put8(snapshot_t* snapshot, uint8_t value) {
+    if (snapshot->length < snapshot->size) {
+        snapshot->data[snapshot->length++] = value;
+    } else {
+        snapshot->full = true;
+    }
+}
+
+void snapshot_put16(snapshot_t* snapshot, uint16_t value) {
+    snapshot_put8(snapshot, value & 0xFF);
+    snapshot_put8(snapshot, value >> 8);
+}
+
+void snapshot_put32(snapshot_t* snapshot, uint32_t value) {
+    snapshot_put16(snapshot, value & 0xFFFF);
+    snapshot_put16(snapshot, value >> 16);
+}
+
+void snapshot_pad(snapshot_t* snapshot, uint8_t record_size, uint16_t count) {
+    uint8_t i;
+    while (count-- > 0) {
+        for (i = 0; i < record_size; ++i) {
+            snapshot_put8(snapshot, 0xFF);
+        }
+    }
+}
+
+void snapshot_section(snapshot_t* snapshot, snapshot_type_t type, uint8_t record_size, uint16_t count) {
+    snapshot_put8(snapshot, type);
+    snapshot_put8(snapshot, record_size);
+    snapshot_put16(snapshot, count);
+    snapshot->sections++;
+}
+
+bool snapshot_register(snapshot_source_t source, void* context) {
+    if (snapshot_counter >= SNAPSHOT_SOURCES || source == NULL) {
+        return false;
+    }
+    snapshot_sources[snapshot_counter].source = source;
+    snapshot_sources[snapshot_counter].context = context;
+    snapshot_counter++;
+    return true;
+}
+
+size_t snapshot_take(uint8_t* buffer, size_t size) {
+    snapshot_t snapshot;
+    unsigned short i;
+    snapshot.data = buffer;
+    snapshot.size = size;
+    snapshot.length = 0;
+    snapshot.sections = 0;
+    snapshot.full = false;
+    // Header, with sections and length written at the end
+    snapshot_put16(&snapshot, SNAPSHOT_MAGIC);
+    snapshot_put8(&snapshot, SNAPSHOT_VERSION);
+    snapshot_put8(&snapshot, 0);
+    snapshot_put16(&snapshot, 0);
+    snapshot_put16(&snapshot, 0);
+    snapshot_put32(&snapshot, task_get_ticks());
+    event_snapshot(&snapshot);
+    task_snapshot(&snapshot);
+    module_snapshot(&snapshot);
+    gpio_snapshot(&snapshot);
+    for (i = 0; i < snapshot_counter; ++i) {
+        snapshot_sources[i].source(&snapshot, snapshot_sources[i].context);
+    }
+    if (snapshot.full || snapshot.length > 0xFFFF) {
+        return 0;
+    }
+    buffer[3] = snapshot.sections;
+    buffer[4] = snapshot.length & 0xFF;
+    buffer[5] = snapshot.length >> 8;
+    return snapshot.length;
+}
@@ -39,7 +39,7 @@ void reset_timer(soft_timer_t *timer) {
     timer->counter = 0;
 }
 
-bool __attribute__((always_inline)) run_timer(soft_timer_t *timer) {
+inline bool run_timer(soft_timer_t *timer) {
     if ((timer->counter + 1) >= timer->time) {
         timer->counter = 0;
         return true;
@@ -20,9 +20,15 @@
 /******************************************************************************/
 
 #include "system/task_manager.h"
+#include "system/trace.h"
+#include "system/cpu_load.h"
+#include "system/critical.h"
+#include "system/snapshot.h"
 
 /// Max number of task
+#ifndef MAX_TASKS
 #define MAX_TASKS 16
+#endif
 /// Max number of arguments
 #define MAX_ARGV 2
 /**
@@ -41,7 +47,7 @@ typedef struct _tagTASK {
     uint16_t counter_freq;
     frequency_t frequency;
     int argc;
-    int argv[MAX_ARGV];
+    event_arg_t argv[MAX_ARGV];
 } TASK;
 
 /******************************************************************************/
@@ -53,6 +59,8 @@ TASK tasks[MAX_TASKS];
 unsigned short task_count = 0;
 /// frequency TIMER
 frequency_t FREQ_TIMER;
+/// Number of task manager calls
+volatile uint32_t task_ticks = 0;
 /*****************************************************************************/
 /* Communication Functions                                                   */
 /*****************************************************************************/
@@ -60,6 +68,7 @@ frequency_t FREQ_TIMER;
 void task_init(frequency_t timer_frequency) {
     hTask_t taskIndex;
     FREQ_TIMER = timer_frequency;
+    task_ticks = 0;
     for (taskIndex = 0; taskIndex < MAX_TASKS; ++taskIndex) {
         tasks[taskIndex].run = STOP;
         tasks[taskIndex].counter = 0;
@@ -88,7 +97,7 @@ hTask_t task_load_data(hEvent_t hEvent, frequency_t frequency, int argc, ...) {
                 tasks[taskIndex].argc = argc;
                 va_start(argp, argc);
                 for(argc_counter = 0; argc_counter < argc; ++argc_counter) {
-                    tasks[taskIndex].argv[argc_counter] = va_arg(argp, int);
+                    tasks[taskIndex].argv[argc_counter] = va_arg(argp, event_arg_t);
                 }
                 task_count++;
                 return taskIndex;
@@ -133,17 +142,97 @@ hModule_t task_get_name(hTask_t taskIndex) {
     return get_event_name(tasks[taskIndex].event);
 }
 
+hTask_t task_next(hModule_t module, hTask_t from) {
+    hTask_t taskIndex;
+    for (taskIndex = from; taskIndex < MAX_TASKS; ++taskIndex) {
+        if (tasks[taskIndex].event != INVALID_EVENT_HANDLE && get_event_name(tasks[taskIndex].event) == module) {
+            return taskIndex;
+        }
+    }
+    return INVALID_TASK_HANDLE;
+}
+
+void task_snapshot(snapshot_t* snapshot) {
+    critical_t section;
+    TASK task;
+    hTask_t taskIndex;
+    uint16_t count = 0;
+    for (taskIndex = 0; taskIndex < MAX_TASKS; ++taskIndex) {
+        if (tasks[taskIndex].event != INVALID_EVENT_HANDLE) {
+            count++;
+        }
+    }
+    snapshot_section(snapshot, SNAPSHOT_TASKS, SNAPSHOT_TASK_SIZE, count);
+    for (taskIndex = 0; taskIndex < MAX_TASKS && count > 0; ++taskIndex) {
+        CRITICAL_ENTER(section, CRITICAL_ALL);
+        task = tasks[taskIndex];
+        CRITICAL_EXIT(section);
+        if (task.event == INVALID_EVENT_HANDLE) {
+            continue;
+        }
+        count--;
+        snapshot_put16(snapshot, taskIndex);
+        snapshot_put16(snapshot, task.event);
+        snapshot_put8(snapshot, task.run);
+        snapshot_put8(snapshot, 0);
+        snapshot_put32(snapshot, task.frequency);
+        snapshot_put16(snapshot, task.counter);
+        snapshot_put16(snapshot, task.counter_freq);
+    }
+    // A task removed in the middle leaves records to fill
+    snapshot_pad(snapshot, SNAPSHOT_TASK_SIZE, count);
+}
+
 unsigned short get_task_number(void) {
     return task_count;
 }
 
+uint32_t task_get_ticks(void) {
+    uint32_t ticks;
+    // The tick ISR can update the counter between the two words of the
+    // read, an interrupt over the tick never sees half an increment
+    do {
+        ticks = task_ticks;
+    } while (ticks != task_ticks);
+    return ticks;
+}
+
+uint16_t task_next_release(void) {
+    hTask_t taskIndex;
+    uint16_t next = TASK_NO_RELEASE;
+    uint16_t ticks;
+    for (taskIndex = 0; taskIndex < MAX_TASKS; ++taskIndex) {
+        if (tasks[taskIndex].run == RUN) {
+            // The task manager releases the task at the tick with counter >= counter_freq
+            if (tasks[taskIndex].counter >= tasks[taskIndex].counter_freq) {
+                ticks = 1;
+            } else {
+                ticks = tasks[taskIndex].counter_freq - tasks[taskIndex].counter + 1;
+            }
+            if (ticks < next) {
+                next = ticks;
+            }
+        }
+    }
+    return next;
+}
+
 inline void task_manager(void) {
+    critical_t section;
+    // The two words in a step for the readers over the tick priority; the
+    // section is not measured, it moves the ticks of the measure
+    critical_enter(&section, NULL, CRITICAL_ALL);
+    task_ticks++;
+    CRITICAL_EXIT(section);
+    cpu_load_enter(CPU_LOAD_TICK);
+    cpu_load_tick();
     if(task_count > 0) {
         hTask_t taskIndex;
         
         for (taskIndex = 0; taskIndex < MAX_TASKS; ++taskIndex) {
             if(tasks[taskIndex].run == RUN) {
                 if (tasks[taskIndex].counter >= tasks[taskIndex].counter_freq) {
+                    TRACE(TRACE_RELEASE, 0, taskIndex);
                     trigger_event_data(tasks[taskIndex].event, tasks[taskIndex].argc, tasks[taskIndex].argv);
                     tasks[taskIndex].counter = 0;
                 }
@@ -151,4 +240,5 @@ inline void task_manager(void) {
             }
         }
     }
+    cpu_load_exit();
 }
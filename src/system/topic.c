@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+ */
+
+/******************************************************************************/
+/* Files to Include                                                           */
+/******************************************************************************/
+
+#include <xc.h>
+#include <string.h>
+
+#include "system/topic.h"
+#include "system/critical.h"
+
+/// Words of a buffer, aligned for any message
+#define TOPIC_WORDS ((TOPIC_BUFFER_SIZE + sizeof(event_arg_t) - 1) / sizeof(event_arg_t))
+/// Subscription without messages
+#define TOPIC_NO_BUFFER 0xFF
+
+#if TOPIC_BUFFERS >= TOPIC_NO_BUFFER || TOPIC_SUBSCRIPTIONS >= 0xFF
+#error "TOPIC_BUFFERS and TOPIC_SUBSCRIPTIONS up to 254"
+#endif
+/**
+ * Information about topic:
+ * Owner module
+ * counters
+ */
+typedef struct _topic {
+    hModule_t owner;
+    topic_stats_t stats;
+} topic_t;
+/**
+ * Information about subscription:
+ * Topic, INVALID_TOPIC_HANDLE for a free subscription
+ * Event of the subscriber
+ * Function to call
+ * Buffer waiting for the callback
+ * Argument of the event, the subscription itself
+ */
+typedef struct _topic_subscription {
+    hTopic_t topic;
+    hEvent_t event;
+    topic_callback_t callback;
+    volatile uint8_t pending;
+    event_arg_t arg;
+} topic_subscription_t;
+
+/******************************************************************************/
+/* Global Variable Declaration                                                */
+/******************************************************************************/
+
+topic_t topics[TOPIC_MAX];
+unsigned short topic_counter = 0;
+topic_subscription_t subscriptions[TOPIC_SUBSCRIPTIONS];
+/// Message buffers, references and size of the message
+event_arg_t topic_data[TOPIC_BUFFERS][TOPIC_WORDS];
+uint8_t topic_refs[TOPIC_BUFFERS];
+size_t topic_size[TOPIC_BUFFERS];
+
+/*****************************************************************************/
+/* Communication Functions                                                   */
+/*****************************************************************************/
+
+void topic_init(void) {
+    unsigned short i;
+    topic_counter = 0;
+    for (i = 0; i < TOPIC_SUBSCRIPTIONS; ++i) {
+        subscriptions[i].topic = INVALID_TOPIC_HANDLE;
+        subscriptions[i].event = INVALID_EVENT_HANDLE;
+        subscriptions[i].callback = NULL;
+        subscriptions[i].pending = TOPIC_NO_BUFFER;
+    }
+    memset(topic_refs, 0, sizeof(topic_refs));
+}
+/**
+ * Number of the buffer
+ * @param data buffer from topic_alloc
+ * @return number, TOPIC_NO_BUFFER for a wrong buffer
+ */
+static uint8_t topic_buffer(const void* data) {
+    const event_arg_t* word = (const event_arg_t*) data;
+    ptrdiff_t offset;
+    if (word < &topic_data[0][0] || word >= &topic_data[0][0] + TOPIC_BUFFERS * TOPIC_WORDS) {
+        return TOPIC_NO_BUFFER;
+    }
+    offset = word - &topic_data[0][0];
+    if (offset % TOPIC_WORDS != 0) {
+        return TOPIC_NO_BUFFER;
+    }
+    return offset / TOPIC_WORDS;
+}
+/**
+ * Drop a reference of the buffer, free after the last one
+ * @param buffer number of the buffer
+ */
+static void topic_release(uint8_t buffer) {
+    critical_t section;
+    CRITICAL_ENTER(section, CRITICAL_ALL);
+    if (topic_refs[buffer] > 0) {
+        topic_refs[buffer]--;
+    }
+    CRITICAL_EXIT(section);
+}
+/**
+ * Event of a subscription, run the callback with the messages up to the
+ * last one, also the ones published during the callback
+ * @param argc unused
+ * @param argv subscription in argv[0]
+ */
+void topic_deliver(int argc, event_arg_t* argv) {
+    topic_subscription_t* subscription = (topic_subscription_t*) argv[0];
+    critical_t section;
+    uint8_t buffer;
+    for (;;) {
+        CRITICAL_ENTER(section, CRITICAL_ALL);
+        buffer = subscription->pending;
+        subscription->pending = TOPIC_NO_BUFFER;
+        CRITICAL_EXIT(section);
+        if (buffer == TOPIC_NO_BUFFER) {
+            return;
+        }
+        subscription->callback(subscription->topic, topic_data[buffer], topic_size[buffer]);
+        topic_release(buffer);
+    }
+}
+
+hTopic_t topic_register(hModule_t owner) {
+    if (topic_counter >= TOPIC_MAX) {
+        return INVALID_TOPIC_HANDLE;
+    }
+    topics[topic_counter].owner = owner;
+    memset(&topics[topic_counter].stats, 0, sizeof(topic_stats_t));
+    return topic_counter++;
+}
+
+hEvent_t topic_subscribe(hTopic_t topic, hModule_t module, topic_callback_t callback, eventPriority priority) {
+    unsigned short i;
+    if (topic >= topic_counter || callback == NULL) {
+        return INVALID_EVENT_HANDLE;
+    }
+    for (i = 0; i < TOPIC_SUBSCRIPTIONS; ++i) {
+        if (subscriptions[i].topic == INVALID_TOPIC_HANDLE) {
+            subscriptions[i].event = register_event_p(module, &topic_deliver, priority);
+            if (subscriptions[i].event == INVALID_EVENT_HANDLE) {
+                return INVALID_EVENT_HANDLE;
+            }
+            subscriptions[i].callback = callback;
+            subscriptions[i].pending = TOPIC_NO_BUFFER;
+            subscriptions[i].arg = (event_arg_t) &subscriptions[i];
+            subscriptions[i].topic = topic;
+            return subscriptions[i].event;
+        }
+    }
+    return INVALID_EVENT_HANDLE;
+}
+
+void* topic_alloc(void) {
+    critical_t section;
+    uint8_t buffer;
+    CRITICAL_ENTER(section, CRITICAL_ALL);
+    for (buffer = 0; buffer < TOPIC_BUFFERS; ++buffer) {
+        if (topic_refs[buffer] == 0) {
+            topic_refs[buffer] = 1;
+            CRITICAL_EXIT(section);
+            return topic_data[buffer];
+        }
+    }
+    CRITICAL_EXIT(section);
+    return NULL;
+}
+
+void topic_free(void* data) {
+    uint8_t buffer = topic_buffer(data);
+    if (buffer != TOPIC_NO_BUFFER) {
+        topic_release(buffer);
+    }
+}
+
+bool topic_publish(hTopic_t topic, void* data, size_t size) {
+    topic_subscription_t* subscription;
+    critical_t section;
+    uint8_t buffer = topic_buffer(data);
+    uint8_t previous;
+    unsigned short i;
+    if (topic >= topic_counter || buffer == TOPIC_NO_BUFFER || size > TOPIC_BUFFER_SIZE) {
+        return false;
+    }
+    topic_size[buffer] = size;
+    for (i = 0; i < TOPIC_SUBSCRIPTIONS; ++i) {
+        subscription = &subscriptions[i];
+        if (subscription->topic != topic) {
+            continue;
+        }
+        CRITICAL_ENTER(section, CRITICAL_ALL);
+        previous = subscription->pending;
+        subscription->pending = buffer;
+        topic_refs[buffer]++;
+        if (previous != TOPIC_NO_BUFFER) {
+            topics[topic].stats.dropped++;
+        }
+        CRITICAL_EXIT(section);
+        if (previous != TOPIC_NO_BUFFER) {
+            topic_release(previous);
+        }
+        trigger_event_data(subscription->event, 1, &subscription->arg);
+    }
+    CRITICAL_ENTER(section, CRITICAL_ALL);
+    topics[topic].stats.published++;
+    CRITICAL_EXIT(section);
+    // Reference of the publisher
+    topic_release(buffer);
+    return true;
+}
+
+bool topic_get_stats(hTopic_t topic, topic_stats_t* stats) {
+    critical_t section;
+    if (topic >= topic_counter) {
+        return false;
+    }
+    CRITICAL_ENTER(section, CRITICAL_ALL);
+    *stats = topics[topic].stats;
+    CRITICAL_EXIT(section);
+    return true;
+}
+
+unsigned short topic_free_buffers(void) {
+    unsigned short free = 0;
+    uint8_t buffer;
+    for (buffer = 0; buffer < TOPIC_BUFFERS; ++buffer) {
+        if (topic_refs[buffer] == 0) {
+            free++;
+        }
+    }
+    return free;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2014-2016 Officine Robotiche
+ * Author: Raffaello Bonghi
+ * email:  raffaello.bonghi@officinerobotiche.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU Lesser General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * https://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+ */
+
+/******************************************************************************/
+/* Files to Include                                                           */
+/******************************************************************************/
+
+#include <xc.h>
+
+#include "system/trace.h"
+#include "system/task_manager.h"
+#include "system/critical.h"
+
+#ifdef KERNEL_TRACE
+
+/******************************************************************************/
+/* Global Variable Declaration                                                */
+/******************************************************************************/
+
+/// Header and ring, contiguous for the dump
+typedef struct _trace_buffer {
+    trace_header_t header;
+    trace_record_t records[TRACE_SIZE];
+} trace_buffer_t;
+
+trace_buffer_t trace;
+/// Timer of the kernel tick
+REGISTER trace_timer;
+/// Recording
+bool trace_enabled = false;
+
+/*****************************************************************************/
+/* Communication Functions                                                   */
+/*****************************************************************************/
+
+void trace_init(REGISTER timer_register, REGISTER pr_timer, frequency_t frequency) {
+    trace_enabled = false;
+    memset(&trace, 0, sizeof(trace));
+    trace_timer = timer_register;
+    trace.header.magic = TRACE_MAGIC;
+    trace.header.version = TRACE_VERSION;
+    trace.header.record_size = sizeof(trace_record_t);
+    trace.header.size = TRACE_SIZE;
+    trace.header.frequency = frequency;
+    trace.header.period = (*pr_timer) + 1;
+    trace_enabled = true;
+}
+
+void trace_enable(bool enable) {
+    trace_enabled = enable;
+}
+
+inline void trace_record(trace_type_t type, uint8_t arg, uint16_t id) {
+    trace_record_t* record;
+    critical_t section;
+    if (!trace_enabled) {
+        return;
+    }
+    // Not measured, the records are taken also inside the measured sections
+    critical_enter(&section, NULL, CRITICAL_ALL);
+    record = &trace.records[trace.header.head];
+    trace.header.head = (trace.header.head + 1) & (TRACE_SIZE - 1);
+    trace.header.count++;
+    record->tick = (uint16_t) task_get_ticks();
+    record->timer = *trace_timer;
+    record->type = type;
+    record->arg = arg;
+    record->id = id;
+    critical_exit(&section);
+}
+
+size_t trace_dump(const void** data) {
+    *data = &trace;
+    return sizeof(trace);
+}
+
+#endif